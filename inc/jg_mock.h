@@ -1,21 +1,41 @@
 #pragma once
 
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
 #include <type_traits>
 #include <tuple>
 #include <functional>
+#include <initializer_list>
+#include <new>
 #include <string>
+#include <utility>
+#include <vector>
 #include "jg_verify.h"
-#include "jg_string.h"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
 
 //
 // These mocking macros are defined and documented at the bottom of this file:
 //
 //   - JG_MOCK
 //   - JG_MOCK_REF
+//   - JG_MOCK_TLS
+//   - JG_MOCK_TLS_REF
+//
+// The spy macros, JG_SPY and JG_SPY_REF, are in jg_mock_spy.h, so that the mocks that don't time
+// their calls don't pay for the latency histograms. Likewise, `jg::mock_delay`, for injecting delays
+// into the calls of a mock, is in jg_mock_inject.h.
 //
 // These compilation flags affect how jg::mock is built 
 //
 //   - JG_MOCK_ENABLE_SHORT_NAMES: Enables mocking macros named without the "JG_" prefix.
+//   - JG_MOCK_FUNC_CAPACITY: The size in bytes of the inline storage for callables assigned to the
+//     `func` auxiliary data member. Assigning a bigger callable is a compilation error.
 //
 
 //
@@ -25,107 +45,1271 @@
 #error jg::mock needs C++14 or newer
 #endif
 
-namespace jg
-{
-namespace detail 
+#if defined(__GNUC__) || defined(__clang__)
+#define JG_MOCK_NOINLINE __attribute__((noinline))
+#elif defined(_MSC_VER)
+#define JG_MOCK_NOINLINE __declspec(noinline)
+#else
+#define JG_MOCK_NOINLINE
+#endif
+
+#ifndef JG_MOCK_FUNC_CAPACITY
+#define JG_MOCK_FUNC_CAPACITY (8 * sizeof(void*))
+#endif
+
+// The return address of the mock function that expands it, which is in the code that called it.
+#if defined(__GNUC__) || defined(__clang__)
+#define _JG_MOCK_RETURN_ADDRESS() __builtin_return_address(0)
+#elif defined(_MSC_VER)
+#define _JG_MOCK_RETURN_ADDRESS() _ReturnAddress()
+#else
+#define _JG_MOCK_RETURN_ADDRESS() nullptr
+#endif
+
+namespace jg
+{
+
+/// How a mock function records the parameters it's called with, see `mock_aux_parameters::capture_params()`.
+enum class mock_capture
+{
+    none,    // Nothing is recorded, for mocks where the parameters are never examined.
+    copy,    // The parameters are copied, which is the default.
+    move,    // Parameters passed by value are moved instead of copied when `func` isn't set, and copied otherwise.
+    summary, // Only the size and a hash of each parameter are recorded, see `mock_aux_parameters::param_summary()`.
+};
+
+/// What a mock function returns after the last of its `results`, see `mock_results`.
+enum class mock_results_end
+{
+    repeat_last, // The last result is returned by the following calls, which is the default.
+    wrap_around, // The results are returned in order again, from the first one.
+    fail,        // A call fails through `jg::verify`, and returns the last result if the failure doesn't terminate.
+};
+
+/// How a mock function waits out an injected delay, see `jg::mock_delay`.
+enum class mock_wait
+{
+    sleep, // The calling thread sleeps, like it would while blocked on I/O, which is the default.
+    spin,  // The calling thread busy-waits, for delays shorter than the scheduler's sleep granularity.
+};
+
+/// A delay that a mock function injects into each call, which is defined in `jg_mock_inject.h`.
+class mock_delay;
+
+/// The size and hash of a parameter recorded with `jg::mock_capture::summary`. A parameter with `data()`
+/// and `size()` members, like `std::string` or `std::vector`, is summarized by its element count and
+/// the hash of its elements' bytes. Other parameters are summarized by their `sizeof` and, if they're
+/// trivially copyable, the hash of their bytes. The hash is 0 when the bytes can't be hashed.
+///
+/// Hashing reads every byte, so it's no cheaper than copying contiguous bytes into storage that's reused
+/// from the previous call. A summary pays off for parameters that are expensive to copy, like containers
+/// of strings, whose elements aren't hashed.
+struct mock_param_summary final
+{
+    size_t size;
+    std::uint64_t hash;
+};
+
+/// Resets every mock in the process in constant time, whatever the number of mocks, for instance between
+/// the test cases of a suite with many global mocks. It starts a new mock epoch, and each mock clears its
+/// state lazily, the next time it's called or used in the new epoch. The `func`, `result` and `results`
+/// set in an earlier epoch are then unset, and other state, like `count()` and the recorded parameters,
+/// is as after `reset()`.
+///
+/// No mock may be in use on another thread during the call, and a mock that's called concurrently must be
+/// used on one thread, for instance by `concurrent(true)`, before the concurrent calls of the new epoch.
+inline void reset_all_mocks();
+
+namespace detail 
+{
+
+template <typename T>
+using base_t = std::remove_const_t<std::remove_reference_t<T>>; // C++20 has std::remove_cvref for this.
+
+template <typename ...T>
+using tuple_params_t = std::tuple<base_t<T>...>;
+
+template<size_t N, typename... Params>
+using nth_param_t = std::tuple_element_t<N, std::tuple<Params...>>;
+
+template <size_t N, typename... Params>
+using nth_param_base_t = base_t<nth_param_t<N, Params...>>;
+
+template <size_t N, typename... Params>
+nth_param_t<N, Params...> nth_param(Params&&... params)
+{
+    return std::get<N>(std::forward_as_tuple(params...));
+}
+
+template <typename Signature, size_t Capacity>
+class inline_function;
+
+// A `std::function` replacement that stores its callable in an inline buffer of `Capacity` bytes. It
+// never allocates, and a callable that doesn't fit is a compilation error rather than a heap
+// allocation. Trivially copyable callables, like lambdas capturing references or pointers, are
+// copied and destroyed without any indirect call. Calling an empty instance throws
+// `std::bad_function_call`, just like `std::function` does, but without a branch on the call path.
+template <typename T, typename... Params, size_t Capacity>
+class inline_function<T(Params...), Capacity> final
+{
+public:
+    inline_function() noexcept = default;
+    inline_function(std::nullptr_t) noexcept {}
+
+    inline_function(const inline_function& other)
+    {
+        copy_from(other);
+    }
+
+    template <typename F, typename = std::enable_if_t<!std::is_same<std::decay_t<F>, inline_function>::value>>
+    inline_function(F&& f)
+    {
+        assign(std::forward<F>(f));
+    }
+
+    ~inline_function()
+    {
+        clear();
+    }
+
+    inline_function& operator=(const inline_function& other)
+    {
+        if (this != &other)
+        {
+            clear();
+            copy_from(other);
+        }
+
+        return *this;
+    }
+
+    template <typename F, typename = std::enable_if_t<!std::is_same<std::decay_t<F>, inline_function>::value>>
+    inline_function& operator=(F&& f)
+    {
+        clear();
+        assign(std::forward<F>(f));
+        return *this;
+    }
+
+    inline_function& operator=(std::nullptr_t) noexcept
+    {
+        clear();
+        return *this;
+    }
+
+    explicit operator bool() const noexcept { return m_invoke != &invoke_empty; }
+
+    T operator()(Params... params) const
+    {
+        return m_invoke(const_cast<storage_t*>(&m_storage), std::forward<Params>(params)...);
+    }
+
+private:
+    using storage_t = std::aligned_storage_t<Capacity, alignof(std::max_align_t)>;
+    using invoke_t = T (*)(void*, Params&&...);
+    using copy_t = void (*)(void* target, const void* source);
+    using destroy_t = void (*)(void* callable);
+
+    template <typename F>
+    void assign(F&& f)
+    {
+        using callable_t = std::decay_t<F>;
+
+        static_assert(sizeof(callable_t) <= Capacity,
+                      "The callable is too big for the inline storage, increase JG_MOCK_FUNC_CAPACITY");
+        static_assert(alignof(callable_t) <= alignof(storage_t), "The callable is over-aligned");
+
+        new (&m_storage) callable_t(std::forward<F>(f));
+        m_invoke = &invoke<callable_t>;
+
+        if (!std::is_trivially_copyable<callable_t>::value)
+        {
+            m_copy = &copy<callable_t>;
+            m_destroy = &destroy<callable_t>;
+        }
+    }
+
+    void copy_from(const inline_function& other)
+    {
+        if (other.m_copy)
+            other.m_copy(&m_storage, &other.m_storage);
+        else if (other)
+            std::memcpy(&m_storage, &other.m_storage, sizeof(m_storage));
+
+        m_invoke = other.m_invoke;
+        m_copy = other.m_copy;
+        m_destroy = other.m_destroy;
+    }
+
+    void clear() noexcept
+    {
+        if (m_destroy)
+            m_destroy(&m_storage);
+
+        m_invoke = &invoke_empty;
+        m_copy = nullptr;
+        m_destroy = nullptr;
+    }
+
+    template <typename F>
+    static T invoke(void* callable, Params&&... params)
+    {
+        return (*static_cast<F*>(callable))(std::forward<Params>(params)...);
+    }
+
+    static T invoke_empty(void*, Params&&...)
+    {
+        throw std::bad_function_call();
+    }
+
+    template <typename F>
+    static void copy(void* target, const void* source)
+    {
+        new (target) F(*static_cast<const F*>(source));
+    }
+
+    template <typename F>
+    static void destroy(void* callable)
+    {
+        static_cast<F*>(callable)->~F();
+    }
+
+    storage_t m_storage;
+    invoke_t m_invoke = &invoke_empty;
+    copy_t m_copy = nullptr;        // Null for trivially copyable callables, which are copied with `memcpy`.
+    destroy_t m_destroy = nullptr;  // Null for trivially copyable (and thereby trivially destructible) callables.
+};
+
+// The recorded parameters of a call to a mock function. It's a plain aggregate rather than a `std::tuple`,
+// which instantiates a lot more for each mock function signature, and it's trivially copyable if the
+// parameters are, so that assigning call history entries with trivially copyable parameters compiles
+// to plain copies.
+template <typename... T>
+struct param_tuple
+{
+};
+
+template <typename T, typename... Rest>
+struct param_tuple<T, Rest...>
+{
+    T first;
+    param_tuple<Rest...> rest;
+};
+
+// The last element has no empty `rest` member, which would otherwise take up space.
+template <typename T>
+struct param_tuple<T>
+{
+    T first;
+};
+
+template <size_t N>
+struct param_tuple_element
+{
+    template <typename Tuple>
+    static const auto& get(const Tuple& tuple) { return param_tuple_element<N - 1>::get(tuple.rest); }
+};
+
+template <>
+struct param_tuple_element<0>
+{
+    template <typename Tuple>
+    static const auto& get(const Tuple& tuple) { return tuple.first; }
+};
+
+template <size_t N, typename... T>
+const auto& record_param(const param_tuple<T...>& record) { return param_tuple_element<N>::get(record); }
+
+template <typename... T>
+struct type_list {};
+
+inline std::uint64_t hash_bytes(const void* data, size_t size)
+{
+    // Four independent lanes over 8 byte words keep the multiplications pipelined, since summarizing a
+    // bulk data parameter should cost a fraction of copying it. The tail is folded in byte by byte.
+    const auto bytes = static_cast<const unsigned char*>(data);
+    std::uint64_t lanes[4] = {0x243f6a8885a308d3ull, 0x13198a2e03707344ull, 0xa4093822299f31d0ull, 0x082efa98ec4e6c89ull};
+    size_t offset = 0;
+
+    for (; offset + sizeof(lanes) <= size; offset += sizeof(lanes))
+        for (size_t lane = 0; lane < 4; ++lane)
+        {
+            std::uint64_t word;
+            std::memcpy(&word, bytes + offset + lane * sizeof(word), sizeof(word));
+            lanes[lane] = (lanes[lane] ^ word) * 0x9e3779b97f4a7c15ull;
+            lanes[lane] ^= lanes[lane] >> 29;
+        }
+
+    std::uint64_t hash = size;
+
+    for (const auto lane : lanes)
+        hash = (hash ^ lane) * 0x100000001b3ull;
+
+    for (; offset < size; ++offset)
+        hash = (hash ^ bytes[offset]) * 0x100000001b3ull;
+
+    return hash ^ (hash >> 32);
+}
+
+template <typename T>
+auto summarize(const T& value, int) -> decltype(value.data(), value.size(), mock_param_summary{})
+{
+    using element_t = std::remove_cv_t<std::remove_pointer_t<decltype(value.data())>>;
+    const size_t size = value.size();
+
+    return {size, std::is_trivially_copyable<element_t>::value ? hash_bytes(value.data(), size * sizeof(element_t)) : 0};
+}
+
+template <typename T>
+mock_param_summary summarize(const T& value, long)
+{
+    return {sizeof(T), std::is_trivially_copyable<T>::value ? hash_bytes(&value, sizeof(T)) : 0};
+}
+
+template <typename Target, typename Source>
+void move_or_copy(Target& target, Source& source, std::true_type) { target = std::move(source); }
+
+template <typename Target, typename Source>
+void move_or_copy(Target& target, Source& source, std::false_type) { target = source; }
+
+// Assigns a parameter of a mock function, `source`, to `target`. If `Move` and `Declared`, the declared
+// parameter type, is passed by value, and thereby owned by the mock function, then it's moved.
+template <bool Move, typename Declared, typename Target, typename Source>
+void assign_param(Target& target, Source& source)
+{
+    using movable = std::integral_constant<bool, Move && !std::is_reference<Declared>::value && !std::is_const<Declared>::value>;
+    move_or_copy(target, source, movable{});
+}
+
+template <bool Move, typename T, typename Declared, typename Source>
+void assign_params(param_tuple<T>& target, type_list<Declared>, Source& source)
+{
+    assign_param<Move, Declared>(target.first, source);
+}
+
+// Assigns the parameters of a mock function, `sources`, to `target`, see `assign_param()`.
+template <bool Move, typename T, typename... Rest, typename Declared, typename... RestDeclared, typename Source, typename... Sources>
+void assign_params(param_tuple<T, Rest...>& target, type_list<Declared, RestDeclared...>, Source& source, Sources&... sources)
+{
+    assign_param<Move, Declared>(target.first, source);
+    assign_params<Move>(target.rest, type_list<RestDeclared...>{}, sources...);
+}
+
+/// The parameters of a recorded call to a mock function, see `mock_aux_parameters::call()`.
+template <typename Record>
+class mock_call final
+{
+public:
+    explicit mock_call(const Record& record) : m_record(record) {}
+
+    template <size_t Number>
+    const auto& param() const { return record_param<Number - 1>(m_record); }
+
+private:
+    const Record& m_record;
+};
+
+// An atomic that can be copied, so that the auxiliary data stays copyable. A copy isn't atomic as a whole.
+template <typename T>
+class copyable_atomic final : public std::atomic<T>
+{
+public:
+    copyable_atomic(T value = T{}) noexcept : std::atomic<T>(value) {}
+    copyable_atomic(const copyable_atomic& other) noexcept : std::atomic<T>(other.load(std::memory_order_relaxed)) {}
+
+    copyable_atomic& operator=(const copyable_atomic& other) noexcept
+    {
+        this->store(other.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        return *this;
+    }
+
+    // Increments without a locked instruction, when there are no concurrent increments.
+    void increment_unsynchronized() noexcept
+    {
+        this->store(this->load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+};
+
+// Identifies a set of per-thread call logs, so that they can be cached in thread local storage. An
+// identifier is never reused, and a copy gets a new one, so a cached log is only used by its owner.
+class call_logs_id final
+{
+public:
+    call_logs_id() = default;
+    call_logs_id(const call_logs_id&) {}
+    call_logs_id& operator=(const call_logs_id&) { renew(); return *this; }
+
+    void renew() { m_value = next(); }
+    std::uint64_t value() const { return m_value; }
+
+private:
+    static std::uint64_t next()
+    {
+        static std::atomic<std::uint64_t> id{0};
+        return id.fetch_add(1, std::memory_order_relaxed) + 1;
+    }
+
+    std::uint64_t m_value = next();
+};
+
+// The epoch that `jg::reset_all_mocks()` starts. Constant initialized, so reading it costs no guard.
+inline std::atomic<std::uint64_t>& mock_epoch_counter()
+{
+    static std::atomic<std::uint64_t> epoch{1};
+    return epoch;
+}
+
+inline std::uint64_t mock_epoch()
+{
+    return mock_epoch_counter().load(std::memory_order_relaxed);
+}
+
+// The parameters of a `jg::mock_delay`, as a mock function that injects it keeps them.
+struct mock_delay_parameters final
+{
+    enum class distribution : unsigned char
+    {
+        none,
+        fixed,
+        uniform,
+        heavy_tailed,
+    };
+
+    distribution type = distribution::none;
+    std::int64_t min_ns = 0;
+    std::int64_t max_ns = 0;
+    double shape = 0.0;
+};
+
+// The latency and failure injection of a mock function, see `mock_aux::inject_delay()`. The random
+// numbers are a hash of the seed and a draw counter, so a sequence of calls gets the same delays and
+// failures in every run, and concurrent calls draw without a lock.
+//
+// A mock function only checks `enabled()` and calls `inject()` through a pointer, which is set to
+// `wait_and_fail()` when a delay is injected. That's defined in `jg_mock_inject.h`, with `jg::mock_delay`,
+// so that the mocks that don't inject delays don't need <chrono>, <cmath> and <thread>.
+class mock_injection final
+{
+public:
+    bool enabled() const { return m_inject != nullptr; }
+
+    // Defined in jg_mock_inject.h.
+    void set_delay(const mock_delay& delay, mock_wait wait);
+
+    void set_failure_probability(double probability)
+    {
+        m_failure_probability = probability;
+        update();
+    }
+
+    void set_seed(std::uint64_t seed)
+    {
+        m_seed = seed;
+        m_draws.store(0, std::memory_order_relaxed);
+    }
+
+    // Waits out the delay of a call, and returns whether the call fails.
+    bool inject(bool concurrent) { return m_inject(*this, concurrent); }
+
+private:
+    using inject_t = bool (*)(mock_injection& injection, bool concurrent);
+
+    static bool fail(mock_injection& injection, bool concurrent);
+    static bool wait_and_fail(mock_injection& injection, bool concurrent); // Defined in jg_mock_inject.h.
+
+    void update() { m_inject = m_wait_out != nullptr ? m_wait_out : m_failure_probability > 0.0 ? &fail : nullptr; }
+    double draw(bool concurrent);
+
+    inject_t m_inject = nullptr;
+    inject_t m_wait_out = nullptr; // `wait_and_fail()` while a delay is injected.
+    mock_delay_parameters m_delay;
+    mock_wait m_wait = mock_wait::sleep;
+    double m_failure_probability = 0.0;
+    std::uint64_t m_seed = 0;
+    copyable_atomic<std::uint64_t> m_draws;
+};
+
+inline bool mock_injection::fail(mock_injection& injection, bool concurrent)
+{
+    return injection.m_failure_probability > 0.0 && injection.draw(concurrent) < injection.m_failure_probability;
+}
+
+inline double mock_injection::draw(bool concurrent)
+{
+    std::uint64_t n;
+
+    if (concurrent)
+    {
+        n = m_draws.fetch_add(1, std::memory_order_relaxed);
+    }
+    else
+    {
+        n = m_draws.load(std::memory_order_relaxed);
+        m_draws.increment_unsynchronized();
+    }
+
+    // SplitMix64, and the upper 53 bits as a double in [0, 1).
+    auto z = m_seed + (n + 1) * 0x9e3779b97f4a7c15ull;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    z = z ^ (z >> 31);
+    return static_cast<double>(z >> 11) / 9007199254740992.0;
+}
+
+// The return addresses of the latest calls to a mock function, see `mock_aux::record_callers()`. It's
+// one pointer per call, in a ring buffer that's allocated once, rather than a captured stack trace.
+class caller_log final
+{
+public:
+    explicit caller_log(size_t capacity = 0)
+        : m_callers(capacity)
+    {}
+
+    bool enabled() const { return !m_callers.empty(); }
+
+    void record(void* caller, bool concurrent)
+    {
+        std::uint64_t n;
+
+        if (concurrent)
+        {
+            n = m_next.fetch_add(1, std::memory_order_relaxed);
+        }
+        else
+        {
+            n = m_next.load(std::memory_order_relaxed);
+            m_next.increment_unsynchronized();
+        }
+
+        m_callers[n % m_callers.size()].store(caller, std::memory_order_relaxed);
+    }
+
+    // The recorded return addresses, from the oldest call.
+    std::vector<void*> callers() const
+    {
+        const auto next = m_next.load(std::memory_order_relaxed);
+        const auto size = next < m_callers.size() ? next : std::uint64_t{m_callers.size()};
+        std::vector<void*> callers;
+        callers.reserve(static_cast<size_t>(size));
+
+        for (auto n = next - size; n < next; ++n)
+            callers.push_back(m_callers[n % m_callers.size()].load(std::memory_order_relaxed));
+
+        return callers;
+    }
+
+private:
+    std::vector<copyable_atomic<void*>> m_callers;
+    copyable_atomic<std::uint64_t> m_next;
+};
+
+// The auxiliary data that every mock function has, whatever its signature, which is in a class of its
+// own so that it's only compiled once rather than once per signature.
+class mock_aux_base
+{
+public:
+    size_t      count() const { return stale() ? 0 : m_count.load(std::memory_order_relaxed); }
+    bool        called() const { return count() > 0; }
+    /// The declaration of the mock function. It's a compile time constant that's only copied into a
+    /// `std::string` by this call, so constructing and resetting a mock don't allocate.
+    std::string prototype() const { return m_prototype; }
+
+    /// The return addresses of the latest calls recorded by `record_callers()`, from the oldest call,
+    /// which are in the code that called the mock function. They can be resolved with `jg::symbolize()`.
+    std::vector<void*> callers() const { return stale() ? std::vector<void*>{} : m_callers.callers(); }
+
+protected:
+    friend class mock_impl;
+
+    explicit mock_aux_base(const char* prototype)
+        : m_count(0)
+        , m_prototype(prototype)
+    {}
+
+    void count_call()
+    {
+        if (m_concurrent)
+            m_count.fetch_add(1, std::memory_order_relaxed);
+        else
+            m_count.increment_unsynchronized();
+    }
+
+    void set_concurrent(bool concurrent) { m_concurrent = concurrent; }
+
+    // Whether the state is from before the latest `jg::reset_all_mocks()`, and thereby due to be reset.
+    bool stale() const { return m_epoch != mock_epoch(); }
+
+    void restart()
+    {
+        m_count.store(0, std::memory_order_relaxed);
+        m_concurrent = false;
+        m_injection = mock_injection{};
+        m_callers = caller_log{};
+        m_epoch = mock_epoch();
+    }
+
+    bool inject() { return m_injection.inject(m_concurrent); }
+
+    copyable_atomic<size_t> m_count;
+    const char* m_prototype;
+    bool m_concurrent = false;
+    std::uint64_t m_epoch = mock_epoch();
+    mock_injection m_injection;
+    caller_log m_callers;
+};
+
+// A fixed size array on the heap, for the call history, which instantiates much less than `std::vector`
+// does for each mock function signature.
+template <typename T>
+class heap_array final
+{
+public:
+    explicit heap_array(size_t size)
+        : m_data(size > 0 ? new T[size]() : nullptr)
+        , m_size(size)
+    {}
+
+    heap_array(const heap_array& other)
+        : heap_array(other.m_size)
+    {
+        for (size_t i = 0; i < m_size; ++i)
+            m_data[i] = other.m_data[i];
+    }
+
+    heap_array& operator=(const heap_array& other)
+    {
+        heap_array copy(other);
+        std::swap(m_data, copy.m_data);
+        std::swap(m_size, copy.m_size);
+        return *this;
+    }
+
+    ~heap_array() { delete[] m_data; }
+
+    bool     empty() const { return m_size == 0; }
+    size_t   size() const { return m_size; }
+    T&       operator[](size_t index) { return m_data[index]; }
+    const T& operator[](size_t index) const { return m_data[index]; }
+
+private:
+    T* m_data;
+    size_t m_size;
+};
+
+// The part of the parameters recorded by one thread, or by all threads when the mock isn't concurrent,
+// that doesn't depend on the parameter types: the sequence numbers of the calls, and the position in the
+// call history ring buffer.
+class call_log_base
+{
+public:
+    virtual ~call_log_base() = default;
+
+    // A copy of the complete call log, owned by the caller, for copying the per-thread call logs of a
+    // concurrent mock.
+    virtual call_log_base* clone() const = 0;
+
+    size_t history_capacity() const { return history_sequences.size(); }
+
+    // The history entry of the recorded call at `index`, where 0 is the oldest recorded call.
+    size_t history_entry(size_t index) const
+    {
+        const auto oldest = history_size < history_capacity() ? 0 : history_next;
+        return (oldest + index) % history_capacity();
+    }
+
+    std::uint64_t last_sequence = 0; // 0 until a call is recorded.
+    std::vector<std::uint64_t> history_sequences;
+    size_t history_next = 0;
+    size_t history_size = 0;
+
+protected:
+    explicit call_log_base(size_t history_capacity)
+        : history_sequences(history_capacity)
+    {}
+
+    call_log_base(const call_log_base&) = default;
+    call_log_base& operator=(const call_log_base&) = default;
+
+    // Advances the call history ring buffer past the entry that the call with `sequence` is recorded in.
+    size_t next_history_entry(std::uint64_t sequence)
+    {
+        const auto entry = history_next;
+        history_sequences[entry] = sequence;
+        history_next = history_next + 1 < history_capacity() ? history_next + 1 : 0;
+        history_size += history_size < history_capacity();
+        return entry;
+    }
+};
+
+// The call logs of the threads calling a concurrent mock, and their merged call histories. None of it
+// depends on the parameter types, so it's only compiled once rather than once per mock function signature.
+//
+// Each call finds the call log of its thread through a thread local cache, and gets a sequence number from
+// a shared atomic counter, which is how the logs are merged when they're read. The first call of a thread
+// pushes its call log onto a lock free list, so no call takes a lock, and nothing but <atomic> is needed.
+class concurrent_call_logs final
+{
+public:
+    using create_t = call_log_base* (*)(size_t history_capacity);
+    using merged_t = std::vector<std::pair<const call_log_base*, size_t>>; // Call logs and history entries.
+
+    concurrent_call_logs() = default;
+    concurrent_call_logs(const concurrent_call_logs& other) { *this = other; }
+    concurrent_call_logs& operator=(const concurrent_call_logs& other);
+    ~concurrent_call_logs() { clear(); }
+
+    std::uint64_t next_sequence() { return m_sequence.fetch_add(1, std::memory_order_relaxed) + 1; }
+
+    // The call log of the calling thread, made with `create` on the first call of the thread.
+    call_log_base& thread_log(create_t create, size_t history_capacity);
+
+    // The call log with the latest call, or `none` if no call has been made.
+    const call_log_base& latest_log(const call_log_base& none) const;
+
+    // The recorded calls of all threads in call order. They're only merged again if a call has been made
+    // since the last merge.
+    const merged_t& merged_history() const;
+
+    // Not thread safe, like copying, so it must not be done while the mock is called.
+    void clear();
+
+private:
+    // A thread only pushes a call log for itself, so there's one per thread, and the logs are only
+    // removed by `clear()`.
+    struct thread_call_log final
+    {
+        const void* thread; // The thread local call log cache of the thread, which identifies it.
+        call_log_base* log;
+        thread_call_log* next;
+    };
+
+    thread_call_log* push(const void* thread, call_log_base* log);
+
+    std::atomic<thread_call_log*> m_logs{nullptr};
+    copyable_atomic<std::uint64_t> m_sequence;
+    call_logs_id m_id;
+    mutable merged_t m_merged;               // Points into the call logs, and is thereby never copied.
+    mutable std::uint64_t m_merged_sequence = 0; // The call sequence number when the histories were merged.
+};
+
+inline concurrent_call_logs& concurrent_call_logs::operator=(const concurrent_call_logs& other)
+{
+    if (this == &other)
+        return *this;
+
+    clear();
+
+    for (auto node = other.m_logs.load(std::memory_order_acquire); node != nullptr; node = node->next)
+        push(node->thread, node->log->clone());
+
+    m_sequence = other.m_sequence;
+    return *this;
+}
+
+inline call_log_base& concurrent_call_logs::thread_log(create_t create, size_t history_capacity)
+{
+    struct cached_log final
+    {
+        std::uint64_t id;
+        call_log_base* log;
+    };
+
+    // Shared by all mocks, with enough entries that a thread alternating between a few mocks still hits.
+    static thread_local std::array<cached_log, 16> cache{};
+    const auto id = m_id.value();
+    auto& cached = cache[id % cache.size()];
+
+    if (cached.id == id)
+        return *cached.log;
+
+    auto node = m_logs.load(std::memory_order_acquire);
+
+    while (node != nullptr && node->thread != &cache)
+        node = node->next;
+
+    if (node == nullptr)
+        node = push(&cache, create(history_capacity));
+
+    cached = {id, node->log};
+    return *cached.log;
+}
+
+inline concurrent_call_logs::thread_call_log* concurrent_call_logs::push(const void* thread, call_log_base* log)
+{
+    const auto node = new thread_call_log{thread, log, m_logs.load(std::memory_order_relaxed)};
+
+    while (!m_logs.compare_exchange_weak(node->next, node, std::memory_order_release, std::memory_order_relaxed))
+        ;
+
+    return node;
+}
+
+inline const call_log_base& concurrent_call_logs::latest_log(const call_log_base& none) const
+{
+    const call_log_base* latest = &none;
+
+    for (auto node = m_logs.load(std::memory_order_acquire); node != nullptr; node = node->next)
+        if (node->log->last_sequence > latest->last_sequence)
+            latest = node->log;
+
+    return *latest;
+}
+
+inline const concurrent_call_logs::merged_t& concurrent_call_logs::merged_history() const
 {
+    const auto sequence = m_sequence.load(std::memory_order_acquire);
 
-template <typename T>
-using base_t = std::remove_const_t<std::remove_reference_t<T>>; // C++20 has std::remove_cvref for this.
+    if (sequence == m_merged_sequence)
+        return m_merged;
 
-template <typename ...T>
-using tuple_params_t = std::tuple<base_t<T>...>;
+    // The history of each thread is in call order, so they're merged by taking the oldest of the next
+    // calls of the threads, from a cursor per thread with recorded calls.
+    merged_t cursors;
+    size_t size = 0;
 
-template<size_t N, typename... Params>
-using nth_param_t = std::tuple_element_t<N, std::tuple<Params...>>;
+    for (auto node = m_logs.load(std::memory_order_acquire); node != nullptr; node = node->next)
+    {
+        if (node->log->history_size > 0)
+            cursors.emplace_back(node->log, 0);
 
-template <size_t N, typename... Params>
-using nth_param_base_t = base_t<nth_param_t<N, Params...>>;
+        size += node->log->history_size;
+    }
 
-template <size_t N, typename... Params>
-nth_param_t<N, Params...> nth_param(Params&&... params)
+    const auto next_sequence = [](const merged_t::value_type& cursor)
+    {
+        return cursor.first->history_sequences[cursor.first->history_entry(cursor.second)];
+    };
+
+    m_merged.clear();
+    m_merged.reserve(size);
+
+    while (!cursors.empty())
+    {
+        size_t oldest = 0;
+
+        for (size_t i = 1; i < cursors.size(); ++i)
+            if (next_sequence(cursors[i]) < next_sequence(cursors[oldest]))
+                oldest = i;
+
+        auto& cursor = cursors[oldest];
+        m_merged.emplace_back(cursor.first, cursor.first->history_entry(cursor.second));
+
+        if (++cursor.second == cursor.first->history_size)
+        {
+            cursor = cursors.back();
+            cursors.pop_back();
+        }
+    }
+
+    m_merged_sequence = sequence;
+    return m_merged;
+}
+
+inline void concurrent_call_logs::clear()
 {
-    return std::get<N>(std::forward_as_tuple(params...));
+    auto node = m_logs.exchange(nullptr, std::memory_order_acquire);
+
+    while (node != nullptr)
+    {
+        const auto next = node->next;
+        delete node->log;
+        delete node;
+        node = next;
+    }
+
+    m_id.renew();
+    m_merged.clear();
+    m_merged_sequence = 0;
 }
 
 // The auxiliary data for a mock function that takes N parameters has `param<1>(), ..., param<N>()` members
 // holding the actual N parameters the function was last called with, for usage in tests.
+//
+// It can also record the parameters of every call in a call history, which is opt-in since it costs
+// a copy of the parameters per call. The history is a ring buffer that's allocated once, up front, and
+// it holds the parameters of the latest `capacity` calls. The parameters are assigned to the preallocated
+// entries, which lets types like `std::string` reuse their storage.
+//
+// What is recorded is controlled by `capture_params()`, since copying bulk data parameters on every
+// call can otherwise dominate the cost of a test. The call history is only recorded when the parameters
+// are copied or moved.
+//
+// A concurrent mock records the parameters in a call log per calling thread, see `concurrent_call_logs`.
+// Only what depends on the parameter types is in this class template, since it's compiled once per mock
+// function signature.
 template <size_t N, typename ...Params>
-class mock_aux_parameters
+class mock_aux_parameters : public mock_aux_base
 {
+    using record_t = param_tuple<base_t<Params>...>;
+
+    // The parameters recorded by one thread, or by all threads when the mock isn't concurrent.
+    struct call_log final : call_log_base
+    {
+        explicit call_log(size_t history_capacity)
+            : call_log_base(history_capacity)
+            , history(history_capacity)
+        {}
+
+        static call_log_base* create(size_t history_capacity) { return new call_log(history_capacity); }
+
+        call_log_base* clone() const override { return new call_log(*this); }
+
+        template <typename ...Params2>
+        void record(mock_capture capture, std::uint64_t sequence, bool movable, Params2&... call_params);
+
+        record_t params{};
+        std::array<mock_param_summary, N> summaries{};
+        heap_array<record_t> history;
+    };
+
 public:
+    explicit mock_aux_parameters(const char* prototype)
+        : mock_aux_base(prototype)
+    {}
+
+    template <size_t Number>
+    const auto& param() const
+    {
+        sync();
+        verify(m_capture == mock_capture::copy || m_capture == mock_capture::move);
+        return record_param<Number - 1>(latest_log().params);
+    }
+
     template <size_t Number>
-    auto param() const { return std::get<Number - 1>(m_params); }
+    const mock_param_summary& param_summary() const
+    {
+        sync();
+        verify(m_capture == mock_capture::summary);
+        return latest_log().summaries[Number - 1];
+    }
+
+    /// Sets how the parameters of the following calls are recorded. The default is `jg::mock_capture::copy`.
+    void capture_params(mock_capture capture)
+    {
+        sync();
+        m_capture = capture;
+    }
+
+    /// Starts recording the parameters of the latest `capacity` calls, or stops recording if `capacity` is 0.
+    /// A concurrent mock records the latest `capacity` calls of each calling thread.
+    void record_calls(size_t capacity)
+    {
+        sync();
+        m_history_capacity = capacity;
+        clear_logs();
+    }
+
+    /// The number of recorded calls, which is at most the capacity given to `record_calls` (per calling
+    /// thread, for a concurrent mock).
+    size_t calls() const
+    {
+        sync();
+        return m_concurrent ? m_thread_logs.merged_history().size() : m_log.history_size;
+    }
+
+    /// The parameters of the recorded call at `index`, where 0 is the oldest recorded call and `calls() - 1`
+    /// is the latest one, accessed with `call(index).param<1>(), ..., call(index).param<N>()`.
+    mock_call<record_t> call(size_t index) const
+    {
+        sync();
+
+        if (!m_concurrent)
+        {
+            verify(index < m_log.history_size);
+            return mock_call<record_t>{m_log.history[m_log.history_entry(index)]};
+        }
+
+        const auto& merged = m_thread_logs.merged_history();
+        verify(index < merged.size());
+        return mock_call<record_t>{static_cast<const call_log&>(*merged[index].first).history[merged[index].second]};
+    }
 
 protected:
-    template <typename, typename>
     friend class mock_impl;
 
+    // `params` are the parameters of the mock function itself, and `movable` tells if the mock function
+    // has no further use for them.
     template <typename ...Params2>
-    void set_params(Params2&&... params) { m_params = std::make_tuple(params...); }
+    void set_params(bool movable, Params2&... params)
+    {
+        if (m_capture == mock_capture::none)
+            return;
+
+        if (!m_concurrent)
+            m_log.record(m_capture, 0, movable, params...); // Sequence numbers are only needed for merging.
+        else
+            set_params_concurrently(movable, params...);
+    }
+
+    void set_concurrent(bool concurrent)
+    {
+        mock_aux_base::set_concurrent(concurrent);
+        clear_logs();
+    }
+
+    // Resets the state lazily, from a mock function call or from an accessor, after `jg::reset_all_mocks()`.
+    // The accessors are const, and the mock function itself might be, which is handled like in `mock_impl`.
+    void sync() const
+    {
+        if (stale())
+            const_cast<mock_aux_parameters&>(*this).restart_epoch();
+    }
+
+private:
+    JG_MOCK_NOINLINE void restart_epoch()
+    {
+        restart();
+        m_capture = mock_capture::copy;
+        m_history_capacity = 0;
+        clear_logs();
+    }
+
+    // Kept out of line, so that the call log recording is inlined in the non-concurrent path.
+    template <typename ...Params2>
+    JG_MOCK_NOINLINE void set_params_concurrently(bool movable, Params2&... params)
+    {
+        const auto sequence = m_thread_logs.next_sequence();
+        auto& log = static_cast<call_log&>(m_thread_logs.thread_log(&call_log::create, m_history_capacity));
+        log.record(m_capture, sequence, movable, params...);
+    }
+
+    void clear_logs()
+    {
+        m_log = call_log{m_history_capacity};
+        m_thread_logs.clear();
+    }
 
-    tuple_params_t<Params...> m_params;
+    const call_log& latest_log() const
+    {
+        return m_concurrent ? static_cast<const call_log&>(m_thread_logs.latest_log(m_log)) : m_log;
+    }
+
+    mock_capture m_capture = mock_capture::copy;
+    size_t m_history_capacity = 0;
+    call_log m_log{0};
+    concurrent_call_logs m_thread_logs;
 };
 
+template <size_t N, typename ...Params>
+template <typename ...Params2>
+inline void mock_aux_parameters<N, Params...>::call_log::record(mock_capture capture,
+                                                                std::uint64_t sequence,
+                                                                bool movable,
+                                                                Params2&... call_params)
+{
+    last_sequence = sequence;
+
+    switch (capture)
+    {
+    case mock_capture::none:
+        return;
+
+    case mock_capture::summary:
+        summaries = {{summarize(call_params, 0)...}};
+        return;
+
+    case mock_capture::move:
+        if (movable)
+        {
+            assign_params<true>(params, type_list<Params...>{}, call_params...);
+            break;
+        }
+
+        assign_params<false>(params, type_list<Params...>{}, call_params...);
+        break;
+
+    case mock_capture::copy:
+        assign_params<false>(params, type_list<Params...>{}, call_params...);
+        break;
+    }
+
+    if (!history.empty())
+        history[next_history_entry(sequence)] = params;
+}
+
 // The auxiliary data for a mock function that takes no parameters has no parameter-holding member.
 template <>
-class mock_aux_parameters<0>
+class mock_aux_parameters<0> : public mock_aux_base
 {
+public:
+    explicit mock_aux_parameters(const char* prototype)
+        : mock_aux_base(prototype)
+    {}
+
+protected:
+    friend class mock_impl;
+
+    void set_params(bool) {}
+
+    void sync() const
+    {
+        if (stale())
+            const_cast<mock_aux_parameters&>(*this).restart();
+    }
 };
 
-// Verifies that the wrapped value is set before it gets used.
+// Verifies that the wrapped value is set, in the current mock epoch, before it gets used.
 template <typename T, typename Enable = void>
 class verified;
 
 template <typename T>
-class verified<T, std::enable_if_t<std::is_reference_v<T>>> final
+class verified<T, std::enable_if_t<std::is_reference<T>::value>> final
 {
 public:
     verified& operator=(T other)
     {
         value = &other;
-        assigned = true;
+        assigned_epoch = mock_epoch();
         return *this;
     }
 
     operator T()
     {
-        verify(assigned);
+        verify(assigned_epoch == mock_epoch());
         return *value;
     }
 
 private:
     std::remove_reference_t<T>* value = nullptr;
-    bool assigned = false;
+    std::uint64_t assigned_epoch = 0; // Never current, since the epochs start at 1.
 };
 
 template <typename T>
-class verified<T, std::enable_if_t<!std::is_reference_v<T>>> final
+class verified<T, std::enable_if_t<!std::is_reference<T>::value>> final
 {
 public:
     verified& operator=(const T& other)
     {
         value = other;
-        assigned = true;
+        assigned_epoch = mock_epoch();
         return *this;
     }
 
     verified& operator=(T&& other)
     {
         value = std::move(other);
-        assigned = true;
+        assigned_epoch = mock_epoch();
         return *this;
     }
 
     operator T()
     {
-        verify(assigned);
+        verify(assigned_epoch == mock_epoch());
         return value;
     }
 
 private:
     T value{};
-    bool assigned = false;
+    std::uint64_t assigned_epoch = 0; // Never current, since the epochs start at 1.
+};
+
+// What doesn't depend on the result type of `mock_results`: the position in the results, and what
+// happens after the last one.
+class mock_results_base
+{
+public:
+    /// The number of calls that have returned one of the results, including calls after the last one.
+    size_t consumed() const { return stale() ? 0 : m_next.load(std::memory_order_relaxed); }
+
+    /// Results set before the latest `jg::reset_all_mocks()` are unset.
+    bool   empty() const { return size() == 0; }
+    size_t size() const { return stale() ? 0 : m_size; }
+
+protected:
+    size_t next_index(bool concurrent);
+
+    void restart(size_t size, mock_results_end end)
+    {
+        m_next.store(0, std::memory_order_relaxed);
+        m_size = size;
+        m_end = end;
+        m_epoch = mock_epoch();
+    }
+
+private:
+    bool stale() const { return m_epoch != mock_epoch(); }
+    size_t next_index_after_last(size_t call) const;
+
+    copyable_atomic<size_t> m_next;
+    size_t m_size = 0;
+    mock_results_end m_end = mock_results_end::repeat_last;
+    std::uint64_t m_epoch = 0;
+};
+
+inline size_t mock_results_base::next_index(bool concurrent)
+{
+    size_t call;
+
+    if (concurrent)
+    {
+        call = m_next.fetch_add(1, std::memory_order_relaxed);
+    }
+    else
+    {
+        call = m_next.load(std::memory_order_relaxed);
+        m_next.increment_unsynchronized();
+    }
+
+    if (call < m_size)
+        return call;
+
+    return next_index_after_last(call);
+}
+
+inline size_t mock_results_base::next_index_after_last(size_t call) const
+{
+    switch (m_end)
+    {
+    case mock_results_end::wrap_around:
+        return call % m_size;
+    case mock_results_end::fail:
+        verify(false);
+        return m_size - 1;
+    case mock_results_end::repeat_last:
+        break;
+    }
+
+    return m_size - 1;
+}
+
+// A sequence of results that a mock function returns in order, one per call, when its `func` isn't set.
+// The results are preloaded in contiguous storage, so a call is an index increment and a load, without
+// the dispatch and captured state of a `func` that counts the calls. Results of reference type are
+// stored as `std::reference_wrapper`, and the referenced objects must outlive the calls.
+template <typename T>
+class mock_results final : public mock_results_base
+{
+public:
+    using value_type = std::conditional_t<std::is_reference<T>::value, std::reference_wrapper<std::remove_reference_t<T>>, T>;
+
+    mock_results() = default;
+    mock_results(const mock_results&) = default;
+    mock_results& operator=(const mock_results&) = default;
+
+    /// Sets the results to return in order by the following calls, and then the last one repeatedly.
+    mock_results& operator=(std::initializer_list<value_type> values)
+    {
+        assign(values.begin(), values.end());
+        return *this;
+    }
+
+    /// Sets the results to return in order by the following calls, and what happens after the last one.
+    void assign(std::initializer_list<value_type> values, mock_results_end end = mock_results_end::repeat_last)
+    {
+        assign(values.begin(), values.end(), end);
+    }
+
+    template <typename Iterator>
+    void assign(Iterator first, Iterator last, mock_results_end end = mock_results_end::repeat_last)
+    {
+        m_values.assign(first, last);
+        restart(m_values.size(), end);
+    }
+
+    T next(bool concurrent) { return m_values[next_index(concurrent)]; }
+
+private:
+    std::vector<value_type> m_values;
 };
 
 // The auxiliary data for a mock function that returns non-`void` has a `result` member
@@ -138,6 +1322,24 @@ class mock_aux_return
 public:
     // Verifying that a test doesn't use it without first setting it.
     verified<T> result;
+
+    // Returned in order, one per call, before `result` is used, if it's set.
+    mock_results<T> results;
+
+protected:
+    friend class mock_impl;
+
+    T default_result(bool concurrent)
+    {
+        if (!results.empty())
+            return results.next(concurrent);
+
+        return result;
+    }
+
+    T failure_result() { return m_failure_result; }
+
+    verified<T> m_failure_result;
 };
 
 // The auxiliary data for a mock function that returns `void` has no `result` member, and
@@ -146,111 +1348,204 @@ public:
 template <>
 class mock_aux_return<void>
 {
+protected:
+    friend class mock_impl;
+
+    void default_result(bool) {}
+    void failure_result() {}
 };
 
-template <typename T, typename ...Params>
-class mock_aux final : public mock_aux_return<T>, public mock_aux_parameters<sizeof...(Params), Params...>
+// The prototype string of a mock function, with the surrounding spaces of the stringized declaration
+// trimmed at compile time. `JG_MOCK` makes one `static constexpr` instance per mock function, so
+// constructing and resetting the auxiliary data doesn't copy or allocate anything.
+template <size_t N>
+class mock_prototype final
 {
 public:
-    mock_aux(std::string prototype)
-        : m_count(0)
-        , m_prototype(trim(prototype, " "))
-    {}
+    constexpr mock_prototype(const char (&declaration)[N])
+        : m_string{}
+    {
+        size_t begin = 0;
+        size_t end = N - 1;
+
+        while (begin < end && declaration[begin] == ' ')
+            ++begin;
 
-    std::function<T(Params...)> func;
-    size_t                      count() const { return m_count; }
-    bool                        called() const { return m_count > 0; }
-    std::string                 prototype() const { return m_prototype; }
+        while (end > begin && declaration[end - 1] == ' ')
+            --end;
+
+        for (size_t i = begin; i < end; ++i)
+            m_string[i - begin] = declaration[i];
+    }
 
-    void                        reset() { *this = mock_aux(m_prototype); }
+    constexpr const char* c_str() const { return m_string; }
 
 private:
-    template <typename, typename>
-    friend class mock_impl;
-    
-    size_t m_count;
-    std::string m_prototype;
+    char m_string[N];
 };
 
-template <typename T, typename TImpl, typename Enable = void>
-class mock_impl_base;
+// The `func` of a mock function, which is an `inline_function` that's unset by `jg::reset_all_mocks()`.
+template <typename Signature>
+class mock_func;
 
-// A mock function that returns `void` only calls `func` in its
-// auxiliary data if it's set in the test. Nothing is done if it's not set.
-template <typename T, typename TImpl>
-class mock_impl_base<T, TImpl, std::enable_if_t<std::is_same<T, void>::value>>
+template <typename T, typename... Params>
+class mock_func<T(Params...)> final
 {
 public:
-    template <typename... Params>
-    void impl(Params&&... params)
-    {        
-        auto& aux = static_cast<TImpl*>(this)->aux;
+    mock_func() = default;
+    mock_func(std::nullptr_t) {}
 
-        if (aux.func)
-            aux.func(std::forward<Params>(params)...);
+    template <typename F, typename = std::enable_if_t<!std::is_same<std::decay_t<F>, mock_func>::value>>
+    mock_func& operator=(F&& f)
+    {
+        m_function = std::forward<F>(f);
+        m_epoch = mock_epoch();
+        return *this;
     }
-};
 
-// A mock function that returns non-`void` calls the `func` member
-// in its auxiliary data if it's set in the test. If the `func` member isn't set, then the `result`
-// member is used instead. If the `result` member isn't set, then by default an assertion failure is
-// triggered and a stack trace is output, or the default value for the `result` member type is
-// returned if the bahavior is non-default. The documentation for `jg::verify` has details on how to
-// configure the assertion behavior at compile time.
-// @see jg::verify
-template <typename T, typename TImpl>
-class mock_impl_base<T, TImpl, std::enable_if_t<!std::is_same<T, void>::value>>
-{
-public:
-    template <typename... Params>
-    T impl(Params&&... params)
+    mock_func& operator=(std::nullptr_t) noexcept
     {
-        auto& aux = static_cast<TImpl*>(this)->aux;
-        
-        if (aux.func)
-            return aux.func(std::forward<Params>(params)...);
-        
-        return aux.result;
+        m_function = nullptr;
+        return *this;
+    }
+
+    explicit operator bool() const noexcept { return m_epoch == mock_epoch() && m_function; }
+
+    T operator()(Params... params) const
+    {
+        return m_function(std::forward<Params>(params)...);
     }
+
+private:
+    inline_function<T(Params...), JG_MOCK_FUNC_CAPACITY> m_function;
+    std::uint64_t m_epoch = 0;
 };
 
-// A mock function does 2 things: it makes sure that its auxiliary data state (call counter, etc.)
-// has been updated when the function returns, and it calls the client supplied callable or returns
-// the client supplied result.
-template <typename T, typename TMockAux>
-class mock_impl final : public mock_impl_base<T, mock_impl<T, TMockAux>>
+template <typename Signature>
+class mock_aux;
+
+// The auxiliary data of a mock function is only instantiated once per function signature, `T(Params...)`,
+// however many mock functions there are with that signature.
+template <typename T, typename ...Params>
+class mock_aux<T(Params...)> : public mock_aux_return<T>, public mock_aux_parameters<sizeof...(Params), Params...>
 {
 public:
-    TMockAux& aux;
-
-    mock_impl(const TMockAux& aux)
-        : aux(const_cast<TMockAux&>(aux)) // Minor hack to be able to use the same JG_MOCK macro for
-                                          // both member functions and free functions. `mutable`
-                                          // would otherwise be needed for some member functions,
-                                          // and that would require separate macro implementations.
-                                          // It's a "minor" hack because it's an implementation
-                                          // detail and we know that the original instance is non-const.
+    mock_aux(const char* prototype)
+        : mock_aux_parameters<sizeof...(Params), Params...>(prototype)
     {}
 
-    ~mock_impl()
+    mock_func<T(Params...)> func;
+
+    void reset() { *this = mock_aux(this->m_prototype); }
+
+    /// Makes the mock safe to call from several threads at the same time, or not. It must be set before
+    /// the calls start. The results, like `count()` and `param<N>()`, must be read after the calling threads
+    /// are done, or otherwise synchronized with the test, and `func` must be thread safe itself.
+    void concurrent(bool enabled)
+    {
+        this->sync();
+        this->set_concurrent(enabled);
+    }
+
+    /// Delays each of the following calls, before `func` is called or the result is returned, by a delay
+    /// from `delay`, which is waited out as `wait` says. `jg::mock_delay{}` stops the delays. It needs
+    /// `jg_mock_inject.h`, which defines `jg::mock_delay`.
+    void inject_delay(const mock_delay& delay, mock_wait wait = mock_wait::sleep)
+    {
+        this->sync();
+        this->m_injection.set_delay(delay, wait);
+    }
+
+    /// Makes each of the following calls fail with `probability`, by returning `alternate_result` instead
+    /// of calling `func` or returning the result. A probability of 0 stops the failures.
+    template <typename U = T, typename = std::enable_if_t<!std::is_void<U>::value>>
+    void inject_failures(double probability, U alternate_result)
+    {
+        this->sync();
+        this->m_failure_result = alternate_result;
+        this->m_injection.set_failure_probability(probability);
+    }
+
+    /// Restarts the random delays and failures from `seed`, which is 0 by default. The same seed gives
+    /// the same delays and failures for the same sequence of calls.
+    void inject_seed(std::uint64_t seed)
     {
-        aux.m_count++;
+        this->sync();
+        this->m_injection.set_seed(seed);
     }
 
-    template <typename... Params>
-    T impl(Params&&... params)
+    /// Starts recording the return address of each of the latest `capacity` calls, for `callers()`,
+    /// or stops recording if `capacity` is 0.
+    void record_callers(size_t capacity)
     {
-        aux.set_params(std::forward<Params>(params)...);
-        return mock_impl_base::impl(std::forward<Params>(params)...);
+        this->sync();
+        this->m_callers = caller_log{capacity};
     }
+};
 
-    T impl()
+// A mock function does 3 things: it records its parameters in its auxiliary data, it calls the client
+// supplied callable or returns the client supplied result, and it makes sure that the call counter has
+// been updated when the function returns.
+//
+// A mock function that returns `void` only calls `func` in its auxiliary data if it's set in the test.
+// Nothing is done if it's not set.
+//
+// A mock function that returns non-`void` calls the `func` member in its auxiliary data if it's set in
+// the test. If the `func` member isn't set, then the next of the `results` is returned, if they're set,
+// and otherwise the `result` member is used instead. If the `result`
+// member isn't set, then by default an assertion failure is triggered and a stack trace is output, or
+// the default value for the `result` member type is returned if the bahavior is non-default. The
+// documentation for `jg::verify` has details on how to configure the assertion behavior at compile time.
+// @see jg::verify
+class mock_impl final
+{
+public:
+    // `caller` is the return address of the mock function, see `mock_aux::record_callers()`.
+    template <typename T, typename ...Params, typename ...Args>
+    static T call(void* caller, const mock_aux<T(Params...)>& const_aux, Args&... params)
     {
-        return mock_impl_base::impl();
+        // Minor hack to be able to use the same JG_MOCK macro for both member functions and free
+        // functions. `mutable` would otherwise be needed for some member functions, and that would
+        // require separate macro implementations. It's a "minor" hack because it's an implementation
+        // detail and we know that the original instance is non-const.
+        auto& aux = const_cast<mock_aux<T(Params...)>&>(const_aux);
+        aux.sync();
+        const call_counter counter{aux};
+
+        if (aux.m_callers.enabled())
+            aux.m_callers.record(caller, aux.m_concurrent);
+
+        aux.set_params(!aux.func, params...);
+
+        if (aux.m_injection.enabled() && aux.inject())
+            return aux.failure_result();
+
+        if (aux.func)
+            return aux.func(params...);
+
+        return aux.default_result(aux.m_concurrent);
     }
+
+private:
+    // Counts the call when the mock function returns, also if `func` throws.
+    class call_counter final
+    {
+    public:
+        explicit call_counter(mock_aux_base& aux) : m_aux(aux) {}
+        ~call_counter() { m_aux.count_call(); }
+
+    private:
+        mock_aux_base& m_aux;
+    };
 };
 
 } // namespace detail
+
+inline void reset_all_mocks()
+{
+    detail::mock_epoch_counter().fetch_add(1, std::memory_order_relaxed);
+}
+
 } // namespace jg
 
 // The variadic macro parameter count macros below are derived from these links:
@@ -264,42 +1559,106 @@ public:
 #define _JG_CONCAT(x, y) _JG_CONCAT2(x, y)
 #define _JG_EXPAND(x) x
 #define _JG_GLUE(x, y) x y
-#define _JG_VA_COUNT_2(x0,x1,x2,x3,x4,x5,x6,x7,x8,x9,x10,N,...) N
+#define _JG_VA_COUNT_2(x0,x1,x2,x3,x4,x5,x6,x7,x8,x9,x10,x11,x12,x13,x14,x15,x16,x17,x18,x19,x20,x21,x22,x23,x24,x25,x26,x27,x28,x29,x30,x31,x32,N,...) N
 //
 // Clang and GCC handles empty __VA_ARGS__ differently from MSVC.
 //
 #ifdef _MSC_VER
-#define _JG_VA_COUNT_1(...) _JG_EXPAND(_JG_VA_COUNT_2(__VA_ARGS__,10,9,8,7,6,5,4,3,2,1,0))
+#define _JG_VA_COUNT_1(...) _JG_EXPAND(_JG_VA_COUNT_2(__VA_ARGS__,32,31,30,29,28,27,26,25,24,23,22,21,20,19,18,17,16,15,14,13,12,11,10,9,8,7,6,5,4,3,2,1,0))
 #define _JG_AUGMENTER(...) unused, __VA_ARGS__
 #define _JG_VA_COUNT(...) _JG_VA_COUNT_1(_JG_AUGMENTER(__VA_ARGS__))
 #else
-#define _JG_VA_COUNT_1(...) _JG_EXPAND(_JG_VA_COUNT_2(0, ## __VA_ARGS__,10,9,8,7,6,5,4,3,2,1,0))
-#define _JG_VA_COUNT(...) _JG_VA_COUNT_1(__VA_ARGS__)
+//
+// Empty __VA_ARGS__ are detected without the `, ## __VA_ARGS__` extension, which isn't available in
+// strictly conforming modes like -std=c++14, as described here:
+//
+// https://gustedt.wordpress.com/2010/06/08/detect-empty-macro-arguments/
+//
+#define _JG_HAS_COMMA(...) _JG_VA_COUNT_2(__VA_ARGS__,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,0,0)
+#define _JG_TRIGGER_PARENTHESIS(...) ,
+#define _JG_IS_EMPTY_CASE_0001 ,
+#define _JG_IS_EMPTY_2(a, b, c, d) _JG_HAS_COMMA(_JG_IS_EMPTY_CASE_ ## a ## b ## c ## d)
+#define _JG_IS_EMPTY_1(a, b, c, d) _JG_IS_EMPTY_2(a, b, c, d)
+#define _JG_IS_EMPTY(...) \
+    _JG_IS_EMPTY_1(_JG_HAS_COMMA(__VA_ARGS__), \
+                   _JG_HAS_COMMA(_JG_TRIGGER_PARENTHESIS __VA_ARGS__), \
+                   _JG_HAS_COMMA(__VA_ARGS__ ()), \
+                   _JG_HAS_COMMA(_JG_TRIGGER_PARENTHESIS __VA_ARGS__ ()))
+#define _JG_VA_COUNT_IF_EMPTY_1(count) 0
+#define _JG_VA_COUNT_IF_EMPTY_0(count) count
+#define _JG_VA_COUNT_1(...) _JG_VA_COUNT_2(0, __VA_ARGS__,32,31,30,29,28,27,26,25,24,23,22,21,20,19,18,17,16,15,14,13,12,11,10,9,8,7,6,5,4,3,2,1,0)
+#define _JG_VA_COUNT(...) _JG_CONCAT(_JG_VA_COUNT_IF_EMPTY_, _JG_IS_EMPTY(__VA_ARGS__))(_JG_VA_COUNT_1(__VA_ARGS__))
 #endif
 
+// The parameter declarations, `T1 p1, ..., TN pN`, each defined in terms of the one with one parameter less.
 #define _JG_MOCK_FUNC_PARAMS_DECL_0()
 #define _JG_MOCK_FUNC_PARAMS_DECL_1(T1) T1 p1
-#define _JG_MOCK_FUNC_PARAMS_DECL_2(T1, T2) T1 p1, T2 p2
-#define _JG_MOCK_FUNC_PARAMS_DECL_3(T1, T2, T3) T1 p1, T2 p2, T3 p3
-#define _JG_MOCK_FUNC_PARAMS_DECL_4(T1, T2, T3, T4) T1 p1, T2 p2, T3 p3, T4 p4
-#define _JG_MOCK_FUNC_PARAMS_DECL_5(T1, T2, T3, T4, T5) T1 p1, T2 p2, T3 p3, T4 p4, T5 p5
-#define _JG_MOCK_FUNC_PARAMS_DECL_6(T1, T2, T3, T4, T5, T6) T1 p1, T2 p2, T3 p3, T4 p4, T5 p5, T6 p6
-#define _JG_MOCK_FUNC_PARAMS_DECL_7(T1, T2, T3, T4, T5, T6, T7) T1 p1, T2 p2, T3 p3, T4 p4, T5 p5, T6 p6, T7 p7
-#define _JG_MOCK_FUNC_PARAMS_DECL_8(T1, T2, T3, T4, T5, T6, T7, T8) T1 p1, T2 p2, T3 p3, T4 p4, T5 p5, T6 p6, T7 p7, T8 p8
-#define _JG_MOCK_FUNC_PARAMS_DECL_9(T1, T2, T3, T4, T5, T6, T7, T8, T9) T1 p1, T2 p2, T3 p3, T4 p4, T5 p5, T6 p6, T7 p7, T8 p8, T9 p9
-#define _JG_MOCK_FUNC_PARAMS_DECL_10(T1, T2, T3, T4, T5, T6, T7, T8, T9, T10) T1 p1, T2 p2, T3 p3, T4 p4, T5 p5, T6 p6, T7 p7, T8 p8, T9 p9, T10 p10
-
-#define _JG_MOCK_FUNC_PARAMS_CALL_0()
-#define _JG_MOCK_FUNC_PARAMS_CALL_1(T1) p1
-#define _JG_MOCK_FUNC_PARAMS_CALL_2(T1, T2) p1, p2
-#define _JG_MOCK_FUNC_PARAMS_CALL_3(T1, T2, T3) p1, p2, p3
-#define _JG_MOCK_FUNC_PARAMS_CALL_4(T1, T2, T3, T4) p1, p2, p3, p4
-#define _JG_MOCK_FUNC_PARAMS_CALL_5(T1, T2, T3, T4, T5) p1, p2, p3, p4, p5
-#define _JG_MOCK_FUNC_PARAMS_CALL_6(T1, T2, T3, T4, T5, T6) p1, p2, p3, p4, p5, p6
-#define _JG_MOCK_FUNC_PARAMS_CALL_7(T1, T2, T3, T4, T5, T6, T7) p1, p2, p3, p4, p5, p6, p7
-#define _JG_MOCK_FUNC_PARAMS_CALL_8(T1, T2, T3, T4, T5, T6, T7, T8) p1, p2, p3, p4, p5, p6, p7, p8
-#define _JG_MOCK_FUNC_PARAMS_CALL_9(T1, T2, T3, T4, T5, T6, T7, T8, T9) p1, p2, p3, p4, p5, p6, p7, p8, p9
-#define _JG_MOCK_FUNC_PARAMS_CALL_10(T1, T2, T3, T4, T5, T6, T7, T8, T9, T10) p1, p2, p3, p4, p5, p6, p7, p8, p9, p10
+#define _JG_MOCK_FUNC_PARAMS_DECL_2(T1, T2) _JG_MOCK_FUNC_PARAMS_DECL_1(T1), T2 p2
+#define _JG_MOCK_FUNC_PARAMS_DECL_3(T1, T2, T3) _JG_MOCK_FUNC_PARAMS_DECL_2(T1, T2), T3 p3
+#define _JG_MOCK_FUNC_PARAMS_DECL_4(T1, T2, T3, T4) _JG_MOCK_FUNC_PARAMS_DECL_3(T1, T2, T3), T4 p4
+#define _JG_MOCK_FUNC_PARAMS_DECL_5(T1, T2, T3, T4, T5) _JG_MOCK_FUNC_PARAMS_DECL_4(T1, T2, T3, T4), T5 p5
+#define _JG_MOCK_FUNC_PARAMS_DECL_6(T1, T2, T3, T4, T5, T6) _JG_MOCK_FUNC_PARAMS_DECL_5(T1, T2, T3, T4, T5), T6 p6
+#define _JG_MOCK_FUNC_PARAMS_DECL_7(T1, T2, T3, T4, T5, T6, T7) _JG_MOCK_FUNC_PARAMS_DECL_6(T1, T2, T3, T4, T5, T6), T7 p7
+#define _JG_MOCK_FUNC_PARAMS_DECL_8(T1, T2, T3, T4, T5, T6, T7, T8) _JG_MOCK_FUNC_PARAMS_DECL_7(T1, T2, T3, T4, T5, T6, T7), T8 p8
+#define _JG_MOCK_FUNC_PARAMS_DECL_9(T1, T2, T3, T4, T5, T6, T7, T8, T9) _JG_MOCK_FUNC_PARAMS_DECL_8(T1, T2, T3, T4, T5, T6, T7, T8), T9 p9
+#define _JG_MOCK_FUNC_PARAMS_DECL_10(T1, T2, T3, T4, T5, T6, T7, T8, T9, T10) _JG_MOCK_FUNC_PARAMS_DECL_9(T1, T2, T3, T4, T5, T6, T7, T8, T9), T10 p10
+#define _JG_MOCK_FUNC_PARAMS_DECL_11(T1, T2, T3, T4, T5, T6, T7, T8, T9, T10, T11) _JG_MOCK_FUNC_PARAMS_DECL_10(T1, T2, T3, T4, T5, T6, T7, T8, T9, T10), T11 p11
+#define _JG_MOCK_FUNC_PARAMS_DECL_12(T1, T2, T3, T4, T5, T6, T7, T8, T9, T10, T11, T12) _JG_MOCK_FUNC_PARAMS_DECL_11(T1, T2, T3, T4, T5, T6, T7, T8, T9, T10, T11), T12 p12
+#define _JG_MOCK_FUNC_PARAMS_DECL_13(T1, T2, T3, T4, T5, T6, T7, T8, T9, T10, T11, T12, T13) _JG_MOCK_FUNC_PARAMS_DECL_12(T1, T2, T3, T4, T5, T6, T7, T8, T9, T10, T11, T12), T13 p13
+#define _JG_MOCK_FUNC_PARAMS_DECL_14(T1, T2, T3, T4, T5, T6, T7, T8, T9, T10, T11, T12, T13, T14) _JG_MOCK_FUNC_PARAMS_DECL_13(T1, T2, T3, T4, T5, T6, T7, T8, T9, T10, T11, T12, T13), T14 p14
+#define _JG_MOCK_FUNC_PARAMS_DECL_15(T1, T2, T3, T4, T5, T6, T7, T8, T9, T10, T11, T12, T13, T14, T15) _JG_MOCK_FUNC_PARAMS_DECL_14(T1, T2, T3, T4, T5, T6, T7, T8, T9, T10, T11, T12, T13, T14), T15 p15
+#define _JG_MOCK_FUNC_PARAMS_DECL_16(T1, T2, T3, T4, T5, T6, T7, T8, T9, T10, T11, T12, T13, T14, T15, T16) _JG_MOCK_FUNC_PARAMS_DECL_15(T1, T2, T3, T4, T5, T6, T7, T8, T9, T10, T11, T12, T13, T14, T15), T16 p16
+#define _JG_MOCK_FUNC_PARAMS_DECL_17(T1, T2, T3, T4, T5, T6, T7, T8, T9, T10, T11, T12, T13, T14, T15, T16, T17) _JG_MOCK_FUNC_PARAMS_DECL_16(T1, T2, T3, T4, T5, T6, T7, T8, T9, T10, T11, T12, T13, T14, T15, T16), T17 p17
+#define _JG_MOCK_FUNC_PARAMS_DECL_18(T1, T2, T3, T4, T5, T6, T7, T8, T9, T10, T11, T12, T13, T14, T15, T16, T17, T18) _JG_MOCK_FUNC_PARAMS_DECL_17(T1, T2, T3, T4, T5, T6, T7, T8, T9, T10, T11, T12, T13, T14, T15, T16, T17), T18 p18
+#define _JG_MOCK_FUNC_PARAMS_DECL_19(T1, T2, T3, T4, T5, T6, T7, T8, T9, T10, T11, T12, T13, T14, T15, T16, T17, T18, T19) _JG_MOCK_FUNC_PARAMS_DECL_18(T1, T2, T3, T4, T5, T6, T7, T8, T9, T10, T11, T12, T13, T14, T15, T16, T17, T18), T19 p19
+#define _JG_MOCK_FUNC_PARAMS_DECL_20(T1, T2, T3, T4, T5, T6, T7, T8, T9, T10, T11, T12, T13, T14, T15, T16, T17, T18, T19, T20) _JG_MOCK_FUNC_PARAMS_DECL_19(T1, T2, T3, T4, T5, T6, T7, T8, T9, T10, T11, T12, T13, T14, T15, T16, T17, T18, T19), T20 p20
+#define _JG_MOCK_FUNC_PARAMS_DECL_21(T1, T2, T3, T4, T5, T6, T7, T8, T9, T10, T11, T12, T13, T14, T15, T16, T17, T18, T19, T20, T21) _JG_MOCK_FUNC_PARAMS_DECL_20(T1, T2, T3, T4, T5, T6, T7, T8, T9, T10, T11, T12, T13, T14, T15, T16, T17, T18, T19, T20), T21 p21
+#define _JG_MOCK_FUNC_PARAMS_DECL_22(T1, T2, T3, T4, T5, T6, T7, T8, T9, T10, T11, T12, T13, T14, T15, T16, T17, T18, T19, T20, T21, T22) _JG_MOCK_FUNC_PARAMS_DECL_21(T1, T2, T3, T4, T5, T6, T7, T8, T9, T10, T11, T12, T13, T14, T15, T16, T17, T18, T19, T20, T21), T22 p22
+#define _JG_MOCK_FUNC_PARAMS_DECL_23(T1, T2, T3, T4, T5, T6, T7, T8, T9, T10, T11, T12, T13, T14, T15, T16, T17, T18, T19, T20, T21, T22, T23) _JG_MOCK_FUNC_PARAMS_DECL_22(T1, T2, T3, T4, T5, T6, T7, T8, T9, T10, T11, T12, T13, T14, T15, T16, T17, T18, T19, T20, T21, T22), T23 p23
+#define _JG_MOCK_FUNC_PARAMS_DECL_24(T1, T2, T3, T4, T5, T6, T7, T8, T9, T10, T11, T12, T13, T14, T15, T16, T17, T18, T19, T20, T21, T22, T23, T24) _JG_MOCK_FUNC_PARAMS_DECL_23(T1, T2, T3, T4, T5, T6, T7, T8, T9, T10, T11, T12, T13, T14, T15, T16, T17, T18, T19, T20, T21, T22, T23), T24 p24
+#define _JG_MOCK_FUNC_PARAMS_DECL_25(T1, T2, T3, T4, T5, T6, T7, T8, T9, T10, T11, T12, T13, T14, T15, T16, T17, T18, T19, T20, T21, T22, T23, T24, T25) _JG_MOCK_FUNC_PARAMS_DECL_24(T1, T2, T3, T4, T5, T6, T7, T8, T9, T10, T11, T12, T13, T14, T15, T16, T17, T18, T19, T20, T21, T22, T23, T24), T25 p25
+#define _JG_MOCK_FUNC_PARAMS_DECL_26(T1, T2, T3, T4, T5, T6, T7, T8, T9, T10, T11, T12, T13, T14, T15, T16, T17, T18, T19, T20, T21, T22, T23, T24, T25, T26) _JG_MOCK_FUNC_PARAMS_DECL_25(T1, T2, T3, T4, T5, T6, T7, T8, T9, T10, T11, T12, T13, T14, T15, T16, T17, T18, T19, T20, T21, T22, T23, T24, T25), T26 p26
+#define _JG_MOCK_FUNC_PARAMS_DECL_27(T1, T2, T3, T4, T5, T6, T7, T8, T9, T10, T11, T12, T13, T14, T15, T16, T17, T18, T19, T20, T21, T22, T23, T24, T25, T26, T27) _JG_MOCK_FUNC_PARAMS_DECL_26(T1, T2, T3, T4, T5, T6, T7, T8, T9, T10, T11, T12, T13, T14, T15, T16, T17, T18, T19, T20, T21, T22, T23, T24, T25, T26), T27 p27
+#define _JG_MOCK_FUNC_PARAMS_DECL_28(T1, T2, T3, T4, T5, T6, T7, T8, T9, T10, T11, T12, T13, T14, T15, T16, T17, T18, T19, T20, T21, T22, T23, T24, T25, T26, T27, T28) _JG_MOCK_FUNC_PARAMS_DECL_27(T1, T2, T3, T4, T5, T6, T7, T8, T9, T10, T11, T12, T13, T14, T15, T16, T17, T18, T19, T20, T21, T22, T23, T24, T25, T26, T27), T28 p28
+#define _JG_MOCK_FUNC_PARAMS_DECL_29(T1, T2, T3, T4, T5, T6, T7, T8, T9, T10, T11, T12, T13, T14, T15, T16, T17, T18, T19, T20, T21, T22, T23, T24, T25, T26, T27, T28, T29) _JG_MOCK_FUNC_PARAMS_DECL_28(T1, T2, T3, T4, T5, T6, T7, T8, T9, T10, T11, T12, T13, T14, T15, T16, T17, T18, T19, T20, T21, T22, T23, T24, T25, T26, T27, T28), T29 p29
+#define _JG_MOCK_FUNC_PARAMS_DECL_30(T1, T2, T3, T4, T5, T6, T7, T8, T9, T10, T11, T12, T13, T14, T15, T16, T17, T18, T19, T20, T21, T22, T23, T24, T25, T26, T27, T28, T29, T30) _JG_MOCK_FUNC_PARAMS_DECL_29(T1, T2, T3, T4, T5, T6, T7, T8, T9, T10, T11, T12, T13, T14, T15, T16, T17, T18, T19, T20, T21, T22, T23, T24, T25, T26, T27, T28, T29), T30 p30
+#define _JG_MOCK_FUNC_PARAMS_DECL_31(T1, T2, T3, T4, T5, T6, T7, T8, T9, T10, T11, T12, T13, T14, T15, T16, T17, T18, T19, T20, T21, T22, T23, T24, T25, T26, T27, T28, T29, T30, T31) _JG_MOCK_FUNC_PARAMS_DECL_30(T1, T2, T3, T4, T5, T6, T7, T8, T9, T10, T11, T12, T13, T14, T15, T16, T17, T18, T19, T20, T21, T22, T23, T24, T25, T26, T27, T28, T29, T30), T31 p31
+#define _JG_MOCK_FUNC_PARAMS_DECL_32(T1, T2, T3, T4, T5, T6, T7, T8, T9, T10, T11, T12, T13, T14, T15, T16, T17, T18, T19, T20, T21, T22, T23, T24, T25, T26, T27, T28, T29, T30, T31, T32) _JG_MOCK_FUNC_PARAMS_DECL_31(T1, T2, T3, T4, T5, T6, T7, T8, T9, T10, T11, T12, T13, T14, T15, T16, T17, T18, T19, T20, T21, T22, T23, T24, T25, T26, T27, T28, T29, T30, T31), T32 p32
+
+// The arguments, `, p1, ..., pN`, with a leading comma since they follow the auxiliary data argument.
+#define _JG_MOCK_FUNC_PARAMS_CALL_0(...)
+#define _JG_MOCK_FUNC_PARAMS_CALL_1(...) _JG_MOCK_FUNC_PARAMS_CALL_0(), p1
+#define _JG_MOCK_FUNC_PARAMS_CALL_2(...) _JG_MOCK_FUNC_PARAMS_CALL_1(), p2
+#define _JG_MOCK_FUNC_PARAMS_CALL_3(...) _JG_MOCK_FUNC_PARAMS_CALL_2(), p3
+#define _JG_MOCK_FUNC_PARAMS_CALL_4(...) _JG_MOCK_FUNC_PARAMS_CALL_3(), p4
+#define _JG_MOCK_FUNC_PARAMS_CALL_5(...) _JG_MOCK_FUNC_PARAMS_CALL_4(), p5
+#define _JG_MOCK_FUNC_PARAMS_CALL_6(...) _JG_MOCK_FUNC_PARAMS_CALL_5(), p6
+#define _JG_MOCK_FUNC_PARAMS_CALL_7(...) _JG_MOCK_FUNC_PARAMS_CALL_6(), p7
+#define _JG_MOCK_FUNC_PARAMS_CALL_8(...) _JG_MOCK_FUNC_PARAMS_CALL_7(), p8
+#define _JG_MOCK_FUNC_PARAMS_CALL_9(...) _JG_MOCK_FUNC_PARAMS_CALL_8(), p9
+#define _JG_MOCK_FUNC_PARAMS_CALL_10(...) _JG_MOCK_FUNC_PARAMS_CALL_9(), p10
+#define _JG_MOCK_FUNC_PARAMS_CALL_11(...) _JG_MOCK_FUNC_PARAMS_CALL_10(), p11
+#define _JG_MOCK_FUNC_PARAMS_CALL_12(...) _JG_MOCK_FUNC_PARAMS_CALL_11(), p12
+#define _JG_MOCK_FUNC_PARAMS_CALL_13(...) _JG_MOCK_FUNC_PARAMS_CALL_12(), p13
+#define _JG_MOCK_FUNC_PARAMS_CALL_14(...) _JG_MOCK_FUNC_PARAMS_CALL_13(), p14
+#define _JG_MOCK_FUNC_PARAMS_CALL_15(...) _JG_MOCK_FUNC_PARAMS_CALL_14(), p15
+#define _JG_MOCK_FUNC_PARAMS_CALL_16(...) _JG_MOCK_FUNC_PARAMS_CALL_15(), p16
+#define _JG_MOCK_FUNC_PARAMS_CALL_17(...) _JG_MOCK_FUNC_PARAMS_CALL_16(), p17
+#define _JG_MOCK_FUNC_PARAMS_CALL_18(...) _JG_MOCK_FUNC_PARAMS_CALL_17(), p18
+#define _JG_MOCK_FUNC_PARAMS_CALL_19(...) _JG_MOCK_FUNC_PARAMS_CALL_18(), p19
+#define _JG_MOCK_FUNC_PARAMS_CALL_20(...) _JG_MOCK_FUNC_PARAMS_CALL_19(), p20
+#define _JG_MOCK_FUNC_PARAMS_CALL_21(...) _JG_MOCK_FUNC_PARAMS_CALL_20(), p21
+#define _JG_MOCK_FUNC_PARAMS_CALL_22(...) _JG_MOCK_FUNC_PARAMS_CALL_21(), p22
+#define _JG_MOCK_FUNC_PARAMS_CALL_23(...) _JG_MOCK_FUNC_PARAMS_CALL_22(), p23
+#define _JG_MOCK_FUNC_PARAMS_CALL_24(...) _JG_MOCK_FUNC_PARAMS_CALL_23(), p24
+#define _JG_MOCK_FUNC_PARAMS_CALL_25(...) _JG_MOCK_FUNC_PARAMS_CALL_24(), p25
+#define _JG_MOCK_FUNC_PARAMS_CALL_26(...) _JG_MOCK_FUNC_PARAMS_CALL_25(), p26
+#define _JG_MOCK_FUNC_PARAMS_CALL_27(...) _JG_MOCK_FUNC_PARAMS_CALL_26(), p27
+#define _JG_MOCK_FUNC_PARAMS_CALL_28(...) _JG_MOCK_FUNC_PARAMS_CALL_27(), p28
+#define _JG_MOCK_FUNC_PARAMS_CALL_29(...) _JG_MOCK_FUNC_PARAMS_CALL_28(), p29
+#define _JG_MOCK_FUNC_PARAMS_CALL_30(...) _JG_MOCK_FUNC_PARAMS_CALL_29(), p30
+#define _JG_MOCK_FUNC_PARAMS_CALL_31(...) _JG_MOCK_FUNC_PARAMS_CALL_30(), p31
+#define _JG_MOCK_FUNC_PARAMS_CALL_32(...) _JG_MOCK_FUNC_PARAMS_CALL_31(), p32
 
 #define _JG_MOCK_FUNC_PARAMS_DECL(...) \
     _JG_GLUE(_JG_CONCAT(_JG_MOCK_FUNC_PARAMS_DECL_, _JG_VA_COUNT(__VA_ARGS__)), (__VA_ARGS__))
@@ -307,6 +1666,10 @@ public:
 #define _JG_MOCK_FUNC_PARAMS_CALL(...) \
     _JG_GLUE(_JG_CONCAT(_JG_MOCK_FUNC_PARAMS_CALL_, _JG_VA_COUNT(__VA_ARGS__)), (__VA_ARGS__))
 
+// The trimmed prototype string has static storage duration, and is made once at compile time.
+#define _JG_MOCK_PROTOTYPE(declaration) \
+    []() -> const char* { static constexpr jg::detail::mock_prototype<sizeof(declaration)> prototype{declaration}; return prototype.c_str(); }()
+
 // --------------------------- Implementation details go above this line ---------------------------
 
 /// @macro JG_MOCK
@@ -441,61 +1804,154 @@ public:
 /// gets reset every time the mock class is instantiated. Regardless if a mock is global or not, its
 /// auxiliary data _can_ be reset at any time in a test if needed.
 ///
+/// `jg::reset_all_mocks()` resets every mock at once, in constant time, for instance in the setup of each
+/// test case of a suite with many global mocks. Each mock then resets itself lazily, the next time it's
+/// called or used, so the cost is only paid by the mocks that the test case uses.
+///
 /// @section Auxiliary data members
 ///
 /// The auxiliary data members available for a mock function `foo` that returns void and takes 0 parameters are:
 ///
-///     std::function<void()>            foo_.func;        // can be set in a test
-///     ---------------------------------------------------------------------------
-///     bool                             foo_.called();    // set by the mocking framework
-///     size_t                           foo_.count();     // set by the mocking framework
-///     std::string                      foo_.prototype(); // set by the mocking framework
+///     mock_func<void()>                  foo_.func;        // can be set in a test
+///     -----------------------------------------------------------------------------
+///     bool                               foo_.called();    // set by the mocking framework
+///     size_t                             foo_.count();     // set by the mocking framework
+///     std::string                        foo_.prototype(); // set by the mocking framework
+///     void                               foo_.concurrent(enabled); // can be called in a test
+///     void                               foo_.inject_delay(delay, wait); // can be called in a test
+///     void                               foo_.inject_seed(seed); // can be called in a test
+///     void                               foo_.record_callers(capacity); // can be called in a test
+///     std::vector<void*>                 foo_.callers();   // set by the mocking framework
 ///
 /// The auxiliary data members available for a mock function `foo` that returns `T` and takes 0 parameters are:
 ///
-///     std::function<T()>               foo_.func;        // can be set in a test
-///     T                                foo_.result;      // can be set in a test
-///     ---------------------------------------------------------------------------
-///     bool                             foo_.called();    // set by the mocking framework
-///     size_t                           foo_.count();     // set by the mocking framework
-///     std::string                      foo_.prototype(); // set by the mocking framework
+///     mock_func<T()>                     foo_.func;        // can be set in a test
+///     T                                  foo_.result;      // can be set in a test
+///     mock_results<T>                    foo_.results;     // can be set in a test
+///     -----------------------------------------------------------------------------
+///     bool                               foo_.called();    // set by the mocking framework
+///     size_t                             foo_.count();     // set by the mocking framework
+///     std::string                        foo_.prototype(); // set by the mocking framework
+///     void                               foo_.concurrent(enabled); // can be called in a test
+///     void                               foo_.inject_delay(delay, wait); // can be called in a test
+///     void                               foo_.inject_failures(probability, alternate_result); // can be called in a test
+///     void                               foo_.inject_seed(seed); // can be called in a test
+///     void                               foo_.record_callers(capacity); // can be called in a test
+///     std::vector<void*>                 foo_.callers();   // set by the mocking framework
 ///
 /// The auxiliary data members available for a mock function `foo` that returns void and takes N parameters of types T1..TN:
 ///
-///     std::function<void(T1, ..., TN)> foo_.func;        // can be set in a test
-///     ---------------------------------------------------------------------------
-///     bool                             foo_.called();    // set by the mocking framework
-///     size_t                           foo_.count();     // set by the mocking framework
-///     std::string                      foo_.prototype(); // set by the mocking framework
-///     T1                               foo_.param<1>();  // set by the mocking framework
-///     .                                .
-///     .                                .
-///     TN                               foo_.param<N>()   // set by the mocking framework
+///     mock_func<void(T1, ..., TN)>       foo_.func;        // can be set in a test
+///     -----------------------------------------------------------------------------
+///     bool                               foo_.called();    // set by the mocking framework
+///     size_t                             foo_.count();     // set by the mocking framework
+///     std::string                        foo_.prototype(); // set by the mocking framework
+///     void                               foo_.concurrent(enabled); // can be called in a test
+///     void                               foo_.inject_delay(delay, wait); // can be called in a test
+///     void                               foo_.inject_seed(seed); // can be called in a test
+///     void                               foo_.record_callers(capacity); // can be called in a test
+///     std::vector<void*>                 foo_.callers();   // set by the mocking framework
+///     const T1&                          foo_.param<1>();  // set by the mocking framework
+///     .                                  .
+///     .                                  .
+///     const TN&                          foo_.param<N>()   // set by the mocking framework
+///     void                               foo_.capture_params(capture); // can be called in a test
+///     mock_param_summary                 foo_.param_summary<1..N>(); // set by the mocking framework
+///     void                               foo_.record_calls(capacity); // can be called in a test
+///     size_t                             foo_.calls();     // set by the mocking framework
+///     const T1&                          foo_.call(i).param<1>(); // set by the mocking framework
+///     .                                  .
+///     .                                  .
+///     const TN&                          foo_.call(i).param<N>(); // set by the mocking framework
 ///
 /// The auxiliary data members available for a mock function `foo` that returns T and takes N parameters of types T1..TN:
 ///
-///     std::function<void(T1, ..., TN)> foo_.func;        // can be set in a test
-///     T                                foo_.result;      // can be set in a test
-///     ---------------------------------------------------------------------------
-///     bool                             foo_.called();    // set by the mocking framework
-///     size_t                           foo_.count();     // set by the mocking framework
-///     std::string                      foo_.prototype(); // set by the mocking framework
-///     T1                               foo_.param<1>();  // set by the mocking framework
-///     .                                .
-///     .                                .
-///     TN                               foo_.param<N>()   // set by the mocking framework
+///     mock_func<T(T1, ..., TN)>          foo_.func;        // can be set in a test
+///     T                                  foo_.result;      // can be set in a test
+///     mock_results<T>                    foo_.results;     // can be set in a test
+///     -----------------------------------------------------------------------------
+///     bool                               foo_.called();    // set by the mocking framework
+///     size_t                             foo_.count();     // set by the mocking framework
+///     std::string                        foo_.prototype(); // set by the mocking framework
+///     void                               foo_.concurrent(enabled); // can be called in a test
+///     void                               foo_.inject_delay(delay, wait); // can be called in a test
+///     void                               foo_.inject_failures(probability, alternate_result); // can be called in a test
+///     void                               foo_.inject_seed(seed); // can be called in a test
+///     void                               foo_.record_callers(capacity); // can be called in a test
+///     std::vector<void*>                 foo_.callers();   // set by the mocking framework
+///     const T1&                          foo_.param<1>();  // set by the mocking framework
+///     .                                  .
+///     .                                  .
+///     const TN&                          foo_.param<N>()   // set by the mocking framework
+///     void                               foo_.capture_params(capture); // can be called in a test
+///     mock_param_summary                 foo_.param_summary<1..N>(); // set by the mocking framework
+///     void                               foo_.record_calls(capacity); // can be called in a test
+///     size_t                             foo_.calls();     // set by the mocking framework
+///     const T1&                          foo_.call(i).param<1>(); // set by the mocking framework
+///     .                                  .
+///     .                                  .
+///     const TN&                          foo_.call(i).param<N>(); // set by the mocking framework
+///
+/// The parameters returned by reference from `foo_.param<N>()` are copies, recorded by the mocking framework,
+/// of the parameters that `foo` was last called with. `foo_.capture_params(jg::mock_capture::none)` turns
+/// that off, for mocks on bulk data interfaces where the parameters are never examined, and
+/// `jg::mock_capture::move` and `jg::mock_capture::summary` make it cheaper. `foo_.reset()` restores the
+/// default `jg::mock_capture::copy`.
+///
+/// The call history is opt-in, since it costs a copy of the parameters per call. `foo_.record_calls(capacity)`
+/// allocates a ring buffer for the parameters of the latest `capacity` calls once, so that recording
+/// doesn't distort throughput measurements. `foo_.call(0)` is the oldest recorded call, and
+/// `foo_.call(foo_.calls() - 1)` the latest.
+///
+/// `foo_.record_callers(capacity)` records the return address of each of the latest `capacity` calls,
+/// which is in the code that made the call, for finding out which code paths made unexpected calls. It
+/// costs a pointer per call. `foo_.callers()` returns the addresses from the oldest call, and
+/// `jg::symbolize()`, in `jg_stacktrace.h`, resolves them when a test needs them:
+///
+///     const auto callers = foo_.callers();
+///
+///     for (const auto& frame : jg::symbolize(callers.data(), callers.size()))
+///         std::cout << frame << "\n";
+///
+/// Mock functions are never inlined, so the address is always in the calling function, also when the
+/// compiler devirtualizes the call.
+///
+/// `foo_.concurrent(true)` makes a mock safe to call from several threads at once, for load tests and
+/// for code under test with worker threads. The call count is then atomic and each thread records its
+/// parameters in a call log of its own, so the calls don't contend on a lock. `foo_.param<N>()` is from the
+/// latest call on any thread, and the call histories of the threads, `foo_.record_calls(capacity)` calls
+/// each, are merged in call order.
+///
+/// `foo_.results = {1, 2, 3}` makes the following calls return 1, 2 and 3, in order, and then 3 repeatedly,
+/// without the cost of a `func` that counts its calls. `foo_.results.assign({1, 2, 3}, end)` picks what
+/// happens after the last result with a `jg::mock_results_end`: it's repeated, the results wrap around, or
+/// the call fails through `jg::verify`. `foo_.results.consumed()` is the number of calls that returned one
+/// of the results. `func` takes precedence over `results`, which take precedence over `result`.
+///
+/// `foo_.inject_delay(jg::mock_delay::heavy_tailed(1ms, 1.5, 100ms))` makes the calls behave like a slow or
+/// congested dependency, to test timeouts and backpressure. The delays are fixed, uniformly distributed or
+/// heavy tailed, and slept or busy-waited, see `jg::mock_wait`. `jg::mock_delay` is in `jg_mock_inject.h`,
+/// which a test that injects delays includes. `foo_.inject_failures(0.01, alternate)`
+/// makes 1% of the calls return `alternate` instead of calling `func` or returning the result. The random
+/// delays and failures are reproducible: the same `foo_.inject_seed(seed)` gives the same ones for the same
+/// sequence of calls.
+///
+/// `func` is a `std::function`-like callable that stores the assigned callable inline, without
+/// allocation, so it can be called cheaply hundreds of millions of times. A callable that's bigger than
+/// `JG_MOCK_FUNC_CAPACITY` bytes (64 bytes on 64-bit platforms by default) can't be assigned to it.
 ///
 /// @param prefix "Things to the left in a function declaration". For instance `static`, `virtual`, etc. - often empty.
 /// @param suffix "Things to the right in a function declaration". For instance `override`, `const`, `noexcept`, etc. - often empty.
 /// @param overload_suffix An arbitrary suffix added to the auxiliary data name of overloaded functions to discriminate between them in tests - often empty.
 /// @param return_type The type of the return value, or `void`.
 /// @param function_name The name of the function to mock.
-/// @param variadic Variadic parameter list of parameter types for the function, if any.
+/// @param variadic Variadic parameter list of up to 32 parameter types for the function, if any. A function
+///        without parameters still needs the comma before the empty list, as in `JG_MOCK(,,, void, ping,)`.
 #define JG_MOCK(prefix, suffix, overload_suffix, return_type, function_name, ...) \
-    jg::detail::mock_aux<return_type, __VA_ARGS__> _JG_CONCAT3(function_name, overload_suffix, _) {#return_type " " #function_name "(" #__VA_ARGS__ ") " #suffix}; \
-    prefix return_type function_name(_JG_MOCK_FUNC_PARAMS_DECL(__VA_ARGS__)) suffix \
+    jg::detail::mock_aux<return_type(__VA_ARGS__)> _JG_CONCAT3(function_name, overload_suffix, _) {_JG_MOCK_PROTOTYPE(#return_type " " #function_name "(" #__VA_ARGS__ ") " #suffix)}; \
+    prefix JG_MOCK_NOINLINE return_type function_name(_JG_MOCK_FUNC_PARAMS_DECL(__VA_ARGS__)) suffix \
     { \
-        return jg::detail::mock_impl<return_type, decltype(_JG_CONCAT3(function_name, overload_suffix, _))>(_JG_CONCAT3(function_name, overload_suffix, _)).impl(_JG_MOCK_FUNC_PARAMS_CALL(__VA_ARGS__)); \
+        return jg::detail::mock_impl::call(_JG_MOCK_RETURN_ADDRESS(), _JG_CONCAT3(function_name, overload_suffix, _) _JG_MOCK_FUNC_PARAMS_CALL(__VA_ARGS__)); \
     }
 
 /// @macro JG_MOCK_REF
@@ -557,9 +2013,56 @@ public:
 ///
 /// Mismatched `JG_MOCK` and `JG_MOCK_REF` declarations leads to compilation and linker errors.
 #define JG_MOCK_REF(prefix, suffix, overload_suffix, return_type, function_name, ...) \
-    extern jg::detail::mock_aux<return_type, __VA_ARGS__> _JG_CONCAT3(function_name, overload_suffix, _);
+    extern jg::detail::mock_aux<return_type(__VA_ARGS__)> _JG_CONCAT3(function_name, overload_suffix, _);
+
+/// @macro JG_MOCK_TLS
+///
+/// Declares a mock function like `JG_MOCK` does, but with `thread_local` auxiliary data, so that each
+/// thread sees an auxiliary data instance of its own. It's meant for mocking free functions, like C APIs,
+/// in tests that run concurrently on several threads: each test thread sets its own `result` and `func`
+/// and gets its own `count()` and parameters, without affecting the tests on other threads.
+///
+/// The auxiliary data of a thread is constructed the first time the thread uses it, which doesn't
+/// allocate, and it's destroyed when the thread exits. `jg::reset_all_mocks()` resets the auxiliary data
+/// of every thread. Since a class can't have `thread_local` data members, `JG_MOCK_TLS` can't mock
+/// member functions.
+///
+/// @note A call from a thread that the tested code starts itself uses the auxiliary data of that thread,
+/// not the one of the test thread, so a test whose tested code calls the mock on threads of its own should
+/// use a `JG_MOCK`, with `concurrent(true)`, instead.
+///
+/// @example
+///
+///     JG_MOCK_TLS(,,, int, sqlite3_open, const char*, sqlite3**);
+///
+///     TEST("can run concurrently with other tests that mock sqlite3_open")
+///     {
+///         sqlite3_open_.reset(); // Only this thread's auxiliary data.
+///         sqlite3_open_.result = SQLITE_CANTOPEN;
+///
+///         TEST_ASSERT(!database::open("file.db"));
+///         TEST_ASSERT(sqlite3_open_.called());
+///     }
+///
+/// The parameters of `JG_MOCK_TLS` are those of `JG_MOCK`.
+#define JG_MOCK_TLS(prefix, suffix, overload_suffix, return_type, function_name, ...) \
+    thread_local jg::detail::mock_aux<return_type(__VA_ARGS__)> _JG_CONCAT3(function_name, overload_suffix, _) {_JG_MOCK_PROTOTYPE(#return_type " " #function_name "(" #__VA_ARGS__ ") " #suffix)}; \
+    prefix JG_MOCK_NOINLINE return_type function_name(_JG_MOCK_FUNC_PARAMS_DECL(__VA_ARGS__)) suffix \
+    { \
+        return jg::detail::mock_impl::call(_JG_MOCK_RETURN_ADDRESS(), _JG_CONCAT3(function_name, overload_suffix, _) _JG_MOCK_FUNC_PARAMS_CALL(__VA_ARGS__)); \
+    }
+
+/// @macro JG_MOCK_TLS_REF
+///
+/// Makes an `extern` declaration of the `thread_local` auxiliary data defined by a corresponding usage of
+/// `JG_MOCK_TLS` in a .cpp file, like `JG_MOCK_REF` does for `JG_MOCK`. Each thread sees the same auxiliary
+/// data in every translation unit.
+#define JG_MOCK_TLS_REF(prefix, suffix, overload_suffix, return_type, function_name, ...) \
+    extern thread_local jg::detail::mock_aux<return_type(__VA_ARGS__)> _JG_CONCAT3(function_name, overload_suffix, _);
 
 #ifdef JG_MOCK_ENABLE_SHORT_NAMES
-#define MOCK     JG_MOCK
-#define MOCK_REF JG_MOCK_REF
+#define MOCK         JG_MOCK
+#define MOCK_REF     JG_MOCK_REF
+#define MOCK_TLS     JG_MOCK_TLS
+#define MOCK_TLS_REF JG_MOCK_TLS_REF
 #endif
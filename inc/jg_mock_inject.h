@@ -0,0 +1,119 @@
+#pragma once
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <thread>
+#include "jg_mock.h"
+
+//
+// `jg::mock_delay`, the delays that `inject_delay()` injects into the calls of a mock function, is
+// defined in this file, since drawing and waiting out the delays needs <chrono>, <cmath> and <thread>.
+// A test that injects delays includes it, while `inject_failures()` and `inject_seed()` only need
+// jg_mock.h.
+//
+
+namespace jg
+{
+
+/// A delay that a mock function injects into each call, to model a slow dependency, see `JG_MOCK`.
+/// The delays of the calls are drawn from a fixed, a uniform or a heavy tailed distribution.
+class mock_delay final
+{
+public:
+    /// No delay, which is the default.
+    mock_delay() = default;
+
+    static mock_delay fixed(std::chrono::nanoseconds delay)
+    {
+        return {distribution::fixed, delay, delay, 0.0};
+    }
+
+    /// Delays uniformly distributed between `min` and `max`.
+    static mock_delay uniform(std::chrono::nanoseconds min, std::chrono::nanoseconds max)
+    {
+        return {distribution::uniform, min, max, 0.0};
+    }
+
+    /// Pareto distributed delays of at least `min`, like the latencies of a congested network or a disk
+    /// with a queue. The lower the `shape`, the heavier the tail, where 1.16 makes 20% of the calls take
+    /// 80% of the delay. The delays are capped at `max`, so that the tail can't stall a test.
+    static mock_delay heavy_tailed(std::chrono::nanoseconds min, double shape, std::chrono::nanoseconds max)
+    {
+        return {distribution::heavy_tailed, min, max, shape};
+    }
+
+    bool empty() const { return m_parameters.type == distribution::none; }
+
+    /// The delay for `u`, a uniformly distributed random number in [0, 1).
+    std::chrono::nanoseconds sample(double u) const;
+
+private:
+    friend class detail::mock_injection;
+
+    using distribution = detail::mock_delay_parameters::distribution;
+
+    mock_delay(distribution type, std::chrono::nanoseconds min, std::chrono::nanoseconds max, double shape)
+        : m_parameters{type, min.count(), max < min ? min.count() : max.count(), shape}
+    {}
+
+    explicit mock_delay(const detail::mock_delay_parameters& parameters)
+        : m_parameters(parameters)
+    {}
+
+    detail::mock_delay_parameters m_parameters;
+};
+
+inline std::chrono::nanoseconds mock_delay::sample(double u) const
+{
+    using ns = std::chrono::nanoseconds;
+
+    switch (m_parameters.type)
+    {
+    case distribution::none:
+        return ns{0};
+    case distribution::fixed:
+        return ns{m_parameters.min_ns};
+    case distribution::uniform:
+        return ns{m_parameters.min_ns + static_cast<ns::rep>(u * static_cast<double>(m_parameters.max_ns - m_parameters.min_ns))};
+    case distribution::heavy_tailed:
+        break;
+    }
+
+    const auto delay = static_cast<double>(m_parameters.min_ns) * std::pow(1.0 - u, -1.0 / m_parameters.shape);
+    return ns{delay < static_cast<double>(m_parameters.max_ns) ? static_cast<ns::rep>(delay) : m_parameters.max_ns};
+}
+
+namespace detail
+{
+
+inline void mock_injection::set_delay(const mock_delay& delay, mock_wait wait)
+{
+    m_delay = delay.m_parameters;
+    m_wait = wait;
+    m_wait_out = delay.empty() ? nullptr : &wait_and_fail;
+    update();
+}
+
+inline bool mock_injection::wait_and_fail(mock_injection& injection, bool concurrent)
+{
+    const auto delay = mock_delay{injection.m_delay}.sample(injection.draw(concurrent));
+
+    if (injection.m_wait == mock_wait::sleep)
+    {
+        std::this_thread::sleep_for(delay);
+    }
+    else
+    {
+        const auto deadline = std::chrono::steady_clock::now() + delay;
+
+        while (std::chrono::steady_clock::now() < deadline)
+            ;
+    }
+
+    return fail(injection, concurrent);
+}
+
+} // namespace detail
+
+} // namespace jg
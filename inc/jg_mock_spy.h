@@ -0,0 +1,371 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "jg_mock.h"
+
+//
+// These spy macros, which declare mock functions whose calls are timed, are defined and documented at
+// the bottom of this file:
+//
+//   - JG_SPY
+//   - JG_SPY_REF
+//
+// JG_MOCK_ENABLE_SHORT_NAMES also enables SPY and SPY_REF.
+//
+
+namespace jg
+{
+
+/// The call count and the call latencies of a function spied on with `JG_SPY`, see `jg::mock_spy_stats()`.
+/// The latencies are from a histogram with 8 logarithmic buckets per power of two, so the percentiles
+/// are within 12.5% of the measured latencies, and rounded up.
+struct mock_spy_statistics final
+{
+    const char* prototype;
+    std::uint64_t count;
+    std::uint64_t p50_ns;
+    std::uint64_t p99_ns;
+    std::uint64_t max_ns;
+    double mean_ns;
+};
+
+/// Returns the statistics of every existing `JG_SPY` function, ordered by prototype.
+inline std::vector<mock_spy_statistics> mock_spy_stats();
+
+/// Writes the statistics of every existing `JG_SPY` function, one line per function, to `output`.
+inline void write_mock_spy_stats(std::FILE* output = stderr);
+
+namespace detail
+{
+
+// A histogram of call latencies in nanoseconds, with 8 buckets per power of two, that's lock free to
+// add to and approximately consistent to read while added to.
+class latency_histogram final
+{
+public:
+    latency_histogram() { clear(); }
+
+    latency_histogram(const latency_histogram&) = delete;
+    latency_histogram& operator=(const latency_histogram&) = delete;
+
+    void add(std::uint64_t ns);
+    void clear();
+
+    std::uint64_t count() const;
+    std::uint64_t max() const { return m_max.load(std::memory_order_relaxed); }
+    double        mean() const;
+
+    /// The upper bound of the bucket holding the `fraction` percentile, which is at most `max()`.
+    std::uint64_t percentile(double fraction) const;
+
+private:
+    static constexpr size_t sub_buckets = 8;
+    static constexpr size_t bucket_count = 62 * sub_buckets; // Values below 8 and the 61 powers of two above.
+
+    static size_t        bucket(std::uint64_t ns);
+    static std::uint64_t bucket_upper_bound(size_t index);
+
+    // The count is the sum of the buckets, so that adding a latency costs one atomic increment less.
+    std::array<std::atomic<std::uint64_t>, bucket_count> m_buckets;
+    std::atomic<std::uint64_t> m_sum;
+    std::atomic<std::uint64_t> m_max;
+};
+
+inline void latency_histogram::add(std::uint64_t ns)
+{
+    m_buckets[bucket(ns)].fetch_add(1, std::memory_order_relaxed);
+    m_sum.fetch_add(ns, std::memory_order_relaxed);
+
+    auto max = m_max.load(std::memory_order_relaxed);
+
+    while (ns > max && !m_max.compare_exchange_weak(max, ns, std::memory_order_relaxed))
+        ;
+}
+
+inline void latency_histogram::clear()
+{
+    for (auto& bucket : m_buckets)
+        bucket.store(0, std::memory_order_relaxed);
+
+    m_sum.store(0, std::memory_order_relaxed);
+    m_max.store(0, std::memory_order_relaxed);
+}
+
+inline std::uint64_t latency_histogram::count() const
+{
+    std::uint64_t count = 0;
+
+    for (const auto& bucket : m_buckets)
+        count += bucket.load(std::memory_order_relaxed);
+
+    return count;
+}
+
+inline double latency_histogram::mean() const
+{
+    const auto n = count();
+    return n == 0 ? 0.0 : static_cast<double>(m_sum.load(std::memory_order_relaxed)) / static_cast<double>(n);
+}
+
+inline std::uint64_t latency_histogram::percentile(double fraction) const
+{
+    const auto n = count();
+
+    if (n == 0)
+        return 0;
+
+    const auto rank = std::max<std::uint64_t>(1, static_cast<std::uint64_t>(fraction * static_cast<double>(n) + 0.5));
+    std::uint64_t cumulative = 0;
+
+    for (size_t i = 0; i < bucket_count; ++i)
+    {
+        cumulative += m_buckets[i].load(std::memory_order_relaxed);
+
+        if (cumulative >= rank)
+            return std::min(bucket_upper_bound(i), max());
+    }
+
+    return max();
+}
+
+inline size_t latency_histogram::bucket(std::uint64_t ns)
+{
+    if (ns < sub_buckets)
+        return static_cast<size_t>(ns);
+
+#if defined(__GNUC__) || defined(__clang__)
+    const auto high_bit = static_cast<size_t>(63 - __builtin_clzll(ns));
+#else
+    size_t high_bit = 0;
+
+    for (auto value = ns; value > 1; value >>= 1)
+        ++high_bit;
+#endif
+
+    // The high bit selects the power of two, and the 3 bits below it the bucket within it.
+    return (high_bit - 2) * sub_buckets + static_cast<size_t>((ns >> (high_bit - 3)) & (sub_buckets - 1));
+}
+
+inline std::uint64_t latency_histogram::bucket_upper_bound(size_t index)
+{
+    if (index < sub_buckets)
+        return index;
+
+    const auto high_bit = index / sub_buckets + 2;
+    const auto lower_bound = static_cast<std::uint64_t>(sub_buckets + index % sub_buckets) << (high_bit - 3);
+    return lower_bound + (std::uint64_t{1} << (high_bit - 3)) - 1;
+}
+
+// The latencies of a `JG_SPY` function, which are kept in a registry for `jg::mock_spy_stats()`
+// for as long as the spy exists.
+struct spy_latencies final
+{
+    explicit spy_latencies(const char* prototype) : prototype(prototype) {}
+
+    const char* prototype;
+    latency_histogram histogram;
+};
+
+class spy_registry final
+{
+public:
+    static spy_registry& instance()
+    {
+        static spy_registry registry;
+        return registry;
+    }
+
+    std::shared_ptr<spy_latencies> add(const char* prototype);
+    std::vector<std::shared_ptr<spy_latencies>> spies();
+
+private:
+    std::mutex m_mutex;
+    std::vector<std::weak_ptr<spy_latencies>> m_spies;
+};
+
+inline std::shared_ptr<spy_latencies> spy_registry::add(const char* prototype)
+{
+    auto latencies = std::make_shared<spy_latencies>(prototype);
+
+    std::lock_guard<std::mutex> lock{m_mutex};
+    m_spies.erase(std::remove_if(m_spies.begin(), m_spies.end(), [](const auto& spy) { return spy.expired(); }),
+                  m_spies.end());
+    m_spies.push_back(latencies);
+    return latencies;
+}
+
+inline std::vector<std::shared_ptr<spy_latencies>> spy_registry::spies()
+{
+    std::vector<std::shared_ptr<spy_latencies>> spies;
+
+    std::lock_guard<std::mutex> lock{m_mutex};
+
+    for (const auto& spy : m_spies)
+        if (auto latencies = spy.lock())
+            spies.push_back(std::move(latencies));
+
+    return spies;
+}
+
+// The auxiliary data of a `JG_SPY` function, which is that of a mock function, whose calls are timed
+// into a latency histogram that's registered for `jg::mock_spy_stats()`. It's neither copyable nor
+// assignable, since the registered histogram belongs to one spy.
+template <typename Signature>
+class mock_spy final : public mock_aux<Signature>
+{
+public:
+    mock_spy(const char* prototype)
+        : mock_aux<Signature>(prototype)
+        , m_latencies(spy_registry::instance().add(prototype))
+    {}
+
+    mock_spy(const mock_spy&) = delete;
+    mock_spy& operator=(const mock_spy&) = delete;
+
+    /// Resets the auxiliary data like `mock_aux::reset()` does, and the latency statistics.
+    /// `jg::reset_all_mocks()` doesn't reset the latency statistics, so that they can cover a whole
+    /// soak test.
+    void reset()
+    {
+        mock_aux<Signature>::reset();
+        m_latencies->histogram.clear();
+    }
+
+    /// The call latencies of the spy, also available for all spies from `jg::mock_spy_stats()`.
+    const latency_histogram& latencies() const { return m_latencies->histogram; }
+
+private:
+    friend class mock_spy_impl;
+
+    std::shared_ptr<spy_latencies> m_latencies;
+};
+
+// A spy function does what a mock function does, see `mock_impl`, and times it. The forwarding to the
+// spied implementation is done by the `func` set in the test.
+class mock_spy_impl final
+{
+public:
+    template <typename T, typename ...Params, typename ...Args>
+    static T call(void* caller, const mock_spy<T(Params...)>& spy, Args&... params)
+    {
+        const timer timer{spy.m_latencies->histogram};
+        return mock_impl::call(caller, static_cast<const mock_aux<T(Params...)>&>(spy), params...);
+    }
+
+private:
+    // Adds the latency of the call when the spy function returns, also if `func` throws.
+    class timer final
+    {
+    public:
+        explicit timer(latency_histogram& histogram)
+            : m_histogram(histogram)
+            , m_start(std::chrono::steady_clock::now())
+        {}
+
+        ~timer()
+        {
+            const auto elapsed = std::chrono::steady_clock::now() - m_start;
+            m_histogram.add(static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()));
+        }
+
+    private:
+        latency_histogram& m_histogram;
+        std::chrono::steady_clock::time_point m_start;
+    };
+};
+
+} // namespace detail
+
+inline std::vector<mock_spy_statistics> mock_spy_stats()
+{
+    std::vector<mock_spy_statistics> statistics;
+
+    for (const auto& spy : detail::spy_registry::instance().spies())
+    {
+        const auto& histogram = spy->histogram;
+        statistics.push_back({spy->prototype,
+                              histogram.count(),
+                              histogram.percentile(0.5),
+                              histogram.percentile(0.99),
+                              histogram.max(),
+                              histogram.mean()});
+    }
+
+    std::sort(statistics.begin(), statistics.end(), [](const auto& a, const auto& b)
+    {
+        return std::strcmp(a.prototype, b.prototype) < 0;
+    });
+
+    return statistics;
+}
+
+inline void write_mock_spy_stats(std::FILE* output)
+{
+    for (const auto& spy : mock_spy_stats())
+        std::fprintf(output,
+                     "%s: %llu calls, p50 %llu ns, p99 %llu ns, max %llu ns, mean %.1f ns\n",
+                     spy.prototype,
+                     static_cast<unsigned long long>(spy.count),
+                     static_cast<unsigned long long>(spy.p50_ns),
+                     static_cast<unsigned long long>(spy.p99_ns),
+                     static_cast<unsigned long long>(spy.max_ns),
+                     spy.mean_ns);
+}
+
+} // namespace jg
+
+/// @macro JG_SPY
+///
+/// Declares a spy function, which is a mock function, see `JG_MOCK`, whose calls are also timed. A spy
+/// wraps a real dependency, like a storage or RPC client, for soak and performance tests: its `func` is set
+/// to forward the calls to the real implementation, and it counts the calls and records their latencies in
+/// a lock free histogram. In addition to the auxiliary data members of a mock, a spy function `foo` has:
+///
+///     const latency_histogram&           foo_.latencies(); // set by the mocking framework
+///
+/// `jg::mock_spy_stats()` returns the call count and the p50, p99 and maximum latency of every spy by its
+/// `prototype()`, and `jg::write_mock_spy_stats()` writes them, for instance at the end of a soak test.
+/// `foo_.reset()` also resets the latencies. A spy can't be copied, which makes a class that has one
+/// non-copyable as well.
+///
+/// @example
+///
+///     class spied_storage final : public storage
+///     {
+///     public:
+///         explicit spied_storage(storage& real)
+///         {
+///             read_.func = [&real](const std::string& key) { return real.read(key); };
+///         }
+///
+///         JG_SPY(,override,, std::string, read, const std::string&);
+///     };
+///
+/// The parameters of `JG_SPY` are those of `JG_MOCK`.
+#define JG_SPY(prefix, suffix, overload_suffix, return_type, function_name, ...) \
+    jg::detail::mock_spy<return_type(__VA_ARGS__)> _JG_CONCAT3(function_name, overload_suffix, _) {_JG_MOCK_PROTOTYPE(#return_type " " #function_name "(" #__VA_ARGS__ ") " #suffix)}; \
+    prefix JG_MOCK_NOINLINE return_type function_name(_JG_MOCK_FUNC_PARAMS_DECL(__VA_ARGS__)) suffix \
+    { \
+        return jg::detail::mock_spy_impl::call(_JG_MOCK_RETURN_ADDRESS(), _JG_CONCAT3(function_name, overload_suffix, _) _JG_MOCK_FUNC_PARAMS_CALL(__VA_ARGS__)); \
+    }
+
+/// @macro JG_SPY_REF
+///
+/// Makes an `extern` declaration of the auxiliary data defined by a corresponding usage of `JG_SPY` in a
+/// .cpp file, like `JG_MOCK_REF` does for `JG_MOCK`.
+#define JG_SPY_REF(prefix, suffix, overload_suffix, return_type, function_name, ...) \
+    extern jg::detail::mock_spy<return_type(__VA_ARGS__)> _JG_CONCAT3(function_name, overload_suffix, _);
+
+#ifdef JG_MOCK_ENABLE_SHORT_NAMES
+#define SPY     JG_SPY
+#define SPY_REF JG_SPY_REF
+#endif
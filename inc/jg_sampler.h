@@ -0,0 +1,668 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "jg_stacktrace.h"
+#include "jg_stacktrace_aggregator.h"
+
+#ifndef _WIN32
+#include <cerrno>
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
+#endif
+
+//
+// The signal that interrupts the sampled threads on POSIX platforms can be changed by defining
+// JG_SAMPLER_SIGNAL, for instance to a real-time signal if the process already uses SIGPROF.
+//
+#ifndef _WIN32
+#ifndef JG_SAMPLER_SIGNAL
+#define JG_SAMPLER_SIGNAL SIGPROF
+#endif
+#endif
+
+namespace jg
+{
+
+struct sampler_statistics final
+{
+    std::uint64_t samples;
+    std::uint64_t dropped_samples;
+    std::size_t thread_count;
+    std::chrono::microseconds interval;
+};
+
+namespace detail
+{
+
+// The preallocated samples of one sampled thread. Samples are written by the capturing side (the
+// signal handler on the sampled thread on POSIX, the sampler thread on Windows) and read by the
+// sampler thread, as a single producer, single consumer ring that never allocates or locks. A
+// sample that doesn't fit, since the sampler thread hasn't drained the ring in time, is dropped.
+class sample_buffer final
+{
+public:
+    struct sample final
+    {
+        size_t count;
+        std::array<void*, raw_stack_trace::max_frame_count> addresses;
+    };
+
+    sample_buffer(size_t capacity, size_t frame_count)
+        : m_samples(std::max<size_t>(capacity, 1))
+        , m_frame_count(std::min(frame_count, static_cast<size_t>(raw_stack_trace::max_frame_count)))
+    {}
+
+    size_t frame_count() const { return m_frame_count; }
+    std::uint64_t dropped() const { return m_dropped.load(std::memory_order_relaxed); }
+
+    // Returns the sample to capture into, or null if the ring is full.
+    sample* begin_write()
+    {
+        const auto written = m_written.load(std::memory_order_relaxed);
+
+        if (written - m_read.load(std::memory_order_acquire) == m_samples.size())
+        {
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+            return nullptr;
+        }
+
+        return &m_samples[written % m_samples.size()];
+    }
+
+    // Publishes the sample returned by `begin_write()`, which took `cost_ns` to capture.
+    void end_write(std::uint64_t cost_ns)
+    {
+        m_cost_ns.fetch_add(cost_ns, std::memory_order_relaxed);
+        m_written.store(m_written.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    // Calls `f(const sample&)` for each published sample, and returns the number of samples.
+    template <typename F>
+    size_t drain(F&& f)
+    {
+        const auto written = m_written.load(std::memory_order_acquire);
+        auto read = m_read.load(std::memory_order_relaxed);
+        const auto count = static_cast<size_t>(written - read);
+
+        for (; read != written; ++read)
+            f(m_samples[read % m_samples.size()]);
+
+        m_read.store(read, std::memory_order_release);
+        return count;
+    }
+
+    // Returns the capture time of the samples published since the previous call.
+    std::uint64_t take_cost_ns() { return m_cost_ns.exchange(0, std::memory_order_relaxed); }
+
+private:
+    std::vector<sample> m_samples;
+    size_t m_frame_count;
+    std::atomic<std::uint64_t> m_written{0};
+    std::atomic<std::uint64_t> m_read{0};
+    std::atomic<std::uint64_t> m_dropped{0};
+    std::atomic<std::uint64_t> m_cost_ns{0};
+};
+
+// A thread registered with a `jg::sampler`, with the handle that it's interrupted through.
+class sampled_thread final
+{
+public:
+    sampled_thread(size_t capacity, size_t frame_count)
+        : m_buffer(capacity, frame_count)
+#ifdef _WIN32
+        , m_handle(OpenThread(THREAD_SUSPEND_RESUME | THREAD_GET_CONTEXT | THREAD_QUERY_INFORMATION, FALSE, GetCurrentThreadId()))
+#else
+        , m_handle(pthread_self())
+#endif
+    {}
+
+    ~sampled_thread()
+    {
+#ifdef _WIN32
+        if (m_handle)
+            CloseHandle(m_handle);
+#endif
+    }
+
+    sampled_thread(const sampled_thread&) = delete;
+    sampled_thread& operator=(const sampled_thread&) = delete;
+
+    sample_buffer& buffer() { return m_buffer; }
+
+#ifdef _WIN32
+    HANDLE handle() const { return m_handle; }
+#else
+    pthread_t handle() const { return m_handle; }
+#endif
+
+private:
+    sample_buffer m_buffer;
+#ifdef _WIN32
+    HANDLE m_handle;
+#else
+    pthread_t m_handle;
+#endif
+};
+
+#ifdef _WIN32
+
+// Captures the stack of the suspended `thread` into `addresses`. Must not allocate, since the suspended
+// thread may hold the heap lock. On x64 the stack is unwound with the unwind data of the modules,
+// through `RtlVirtualUnwind`, which doesn't go through DbgHelp.
+inline size_t capture_thread_addresses(HANDLE thread, void** addresses, size_t capacity)
+{
+    CONTEXT context{};
+    context.ContextFlags = CONTEXT_FULL;
+
+    if (!GetThreadContext(thread, &context))
+        return 0;
+
+    size_t count = 0;
+
+#if defined(_M_X64)
+
+    while (count < capacity && context.Rip)
+    {
+        addresses[count++] = reinterpret_cast<void*>(context.Rip);
+
+        DWORD64 image_base = 0;
+        auto* function = RtlLookupFunctionEntry(context.Rip, &image_base, nullptr);
+
+        if (function)
+        {
+            void* handler_data = nullptr;
+            DWORD64 establisher_frame = 0;
+            RtlVirtualUnwind(UNW_FLAG_NHANDLER, image_base, context.Rip, function, &context, &handler_data, &establisher_frame, nullptr);
+        }
+        else
+        {
+            // A leaf function, which has the return address on the top of the stack.
+            context.Rip = *reinterpret_cast<const DWORD64*>(context.Rsp);
+            context.Rsp += 8;
+        }
+    }
+
+#else
+
+    STACKFRAME64 frame{};
+    frame.AddrPC.Mode = AddrModeFlat;
+    frame.AddrFrame.Mode = AddrModeFlat;
+    frame.AddrStack.Mode = AddrModeFlat;
+
+#if defined(_M_IX86)
+    const DWORD machine = IMAGE_FILE_MACHINE_I386;
+    frame.AddrPC.Offset = context.Eip;
+    frame.AddrFrame.Offset = context.Ebp;
+    frame.AddrStack.Offset = context.Esp;
+#else
+    const DWORD machine = IMAGE_FILE_MACHINE_ARM64;
+    frame.AddrPC.Offset = context.Pc;
+    frame.AddrFrame.Offset = context.Fp;
+    frame.AddrStack.Offset = context.Sp;
+#endif
+
+    auto& session = dbghlp_session::instance();
+
+    while (count < capacity &&
+           StackWalk64(machine, session.process(), thread, &frame, &context, nullptr, SymFunctionTableAccess64, SymGetModuleBase64, nullptr) &&
+           frame.AddrPC.Offset)
+        addresses[count++] = reinterpret_cast<void*>(frame.AddrPC.Offset);
+
+#endif
+
+    return count;
+}
+
+#else
+
+inline sample_buffer*& thread_sample_buffer()
+{
+    static thread_local sample_buffer* buffer = nullptr;
+    return buffer;
+}
+
+inline std::uint64_t sample_clock_ns()
+{
+    timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return static_cast<std::uint64_t>(time.tv_sec) * 1000000000 + static_cast<std::uint64_t>(time.tv_nsec);
+}
+
+// Captures a sample of the interrupted thread into its buffer, if it's sampled. Only makes async
+// signal safe calls. The frames of the handler and of the signal trampoline are skipped, so that
+// samples start at the interrupted function. With JG_STACK_TRACE_USE_FRAME_POINTERS they start at
+// its caller, since the interrupted instruction isn't in the frame pointer chain.
+inline void sample_signal_handler(int)
+{
+    const auto saved_errno = errno;
+
+    if (auto* buffer = thread_sample_buffer())
+    {
+        const auto start = sample_clock_ns();
+
+        if (auto* sample = buffer->begin_write())
+        {
+            capture_addresses(sample->addresses.data(), buffer->frame_count(), 2, sample->count);
+            buffer->end_write(sample_clock_ns() - start);
+        }
+    }
+
+    errno = saved_errno;
+}
+
+// The handler is installed once, when the first sampler starts, and stays installed, so that a signal
+// that's still pending when a sampler stops doesn't get the default action, which terminates the
+// process. It ignores the signal on threads that aren't sampled.
+inline bool install_sample_signal_handler()
+{
+    static const bool installed = []
+    {
+        struct sigaction action{};
+        action.sa_handler = sample_signal_handler;
+        action.sa_flags = SA_RESTART;
+        sigemptyset(&action.sa_mask);
+        return sigaction(JG_SAMPLER_SIGNAL, &action, nullptr) == 0;
+    }();
+
+    return installed;
+}
+
+#endif
+
+} // namespace detail
+
+/// @class jg::sampler
+///
+/// A sampling profiler for the threads that register with it. Every `interval()` a background thread
+/// captures the stack of each registered thread, whether it's running or waiting (wall clock time),
+/// into preallocated per-thread sample buffers. The samples are aggregated into unique stacks, which
+/// are symbolized on demand by `traces()` and `write_collapsed()`.
+///
+/// On POSIX platforms the sampled threads are interrupted by a JG_SAMPLER_SIGNAL (SIGPROF) signal
+/// each, and capture their own stack in the signal handler, which never allocates or locks (see
+/// `jg::stack_trace::capture()` for the unwinder requirements). Interrupted system calls are
+/// restarted, but calls that can't be restarted, like `nanosleep`, may fail with `EINTR`. On Windows
+/// the sampled threads are suspended, while the sampler thread walks their stacks.
+///
+/// The time spent capturing samples, summed over the sampled threads, is kept below
+/// `overhead_budget()` of the elapsed time by lengthening the interval when needed. The cost of
+/// delivering the signals or suspending the threads isn't included.
+///
+/// The configuration applies to the threads that register after it's set. A thread is registered
+/// with one sampler at a time, and a `jg::sampler::thread_scope` for another sampler is ignored.
+///
+/// @example
+///
+///     jg::sampler profiler;
+///     profiler.interval(std::chrono::milliseconds(5)).overhead_budget(0.01);
+///     profiler.start();
+///
+///     // On each thread to profile
+///     jg::sampler::thread_scope sampled{profiler};
+///     ...
+///
+///     // When done, for https://github.com/brendangregg/FlameGraph
+///     profiler.stop();
+///     std::ofstream profile("profile.folded");
+///     profiler.write_collapsed(profile);
+class sampler final
+{
+public:
+    /// Registers the calling thread with `sampler` during its lifetime. Must be destroyed on the same
+    /// thread, before the sampler.
+    class thread_scope final
+    {
+    public:
+        explicit thread_scope(sampler& sampler);
+        ~thread_scope();
+
+        thread_scope(const thread_scope&) = delete;
+        thread_scope& operator=(const thread_scope&) = delete;
+
+    private:
+        sampler& m_sampler;
+        std::shared_ptr<detail::sampled_thread> m_thread;
+    };
+
+    sampler() = default;
+    ~sampler() { stop(); }
+
+    sampler(const sampler&) = delete;
+    sampler& operator=(const sampler&) = delete;
+
+    /// The time between samples of each thread, 10 ms by default.
+    sampler& interval(std::chrono::microseconds interval);
+
+    /// The fraction of the elapsed time that capturing samples may take, 0.01 by default.
+    sampler& overhead_budget(double fraction);
+
+    /// The number of frames captured per sample, 32 by default and at most
+    /// `jg::raw_stack_trace::max_frame_count`.
+    sampler& frame_count(size_t count);
+
+    /// The number of samples per thread that are buffered until the sampler thread aggregates them,
+    /// 16 by default. Samples beyond that are dropped.
+    sampler& buffer_capacity(size_t samples);
+
+    /// Starts sampling. Returns false if the signal handler couldn't be installed.
+    bool start();
+
+    /// Stops sampling. The aggregated stacks are kept until `clear()`.
+    void stop();
+
+    bool running() const;
+
+    /// Returns the unique stacks, symbolized, ordered by descending sample count.
+    std::vector<aggregated_stack_trace> traces();
+
+    /// Writes the unique stacks in the collapsed stack format of flame graph tools, one line per stack
+    /// with the frames from the outermost one separated by semicolons, followed by the sample count.
+    void write_collapsed(std::ostream& stream);
+
+    sampler_statistics stats() const;
+
+    void clear();
+
+private:
+    void run();
+    void sample_threads();
+    std::uint64_t drain();
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::thread m_thread;
+    bool m_stopping = false;
+
+    std::vector<std::shared_ptr<detail::sampled_thread>> m_threads;
+    stack_trace_aggregator m_aggregator;
+    std::uint64_t m_samples = 0;
+    std::uint64_t m_removed_dropped_samples = 0;
+
+    std::chrono::microseconds m_interval{10000};
+    std::chrono::microseconds m_effective_interval{10000};
+    double m_overhead_budget = 0.01;
+    size_t m_frame_count = 32;
+    size_t m_buffer_capacity = 16;
+};
+
+inline sampler::thread_scope::thread_scope(sampler& sampler)
+    : m_sampler(sampler)
+{
+#ifndef _WIN32
+    if (detail::thread_sample_buffer())
+        return;
+#endif
+
+    std::lock_guard<std::mutex> lock{m_sampler.m_mutex};
+
+#ifdef _WIN32
+    const auto self = GetCurrentThreadId();
+
+    for (const auto& thread : m_sampler.m_threads)
+        if (GetThreadId(thread->handle()) == self)
+            return;
+#endif
+
+    m_thread = std::make_shared<detail::sampled_thread>(m_sampler.m_buffer_capacity, m_sampler.m_frame_count);
+    m_sampler.m_threads.push_back(m_thread);
+
+#ifndef _WIN32
+    detail::thread_sample_buffer() = &m_thread->buffer();
+    std::atomic_signal_fence(std::memory_order_seq_cst);
+#endif
+}
+
+inline sampler::thread_scope::~thread_scope()
+{
+    if (!m_thread)
+        return;
+
+#ifndef _WIN32
+    // A signal that's delivered from now on finds no buffer to capture into.
+    detail::thread_sample_buffer() = nullptr;
+    std::atomic_signal_fence(std::memory_order_seq_cst);
+#endif
+
+    std::lock_guard<std::mutex> lock{m_sampler.m_mutex};
+    m_sampler.drain();
+    m_sampler.m_removed_dropped_samples += m_thread->buffer().dropped();
+
+    auto& threads = m_sampler.m_threads;
+    threads.erase(std::find(threads.begin(), threads.end(), m_thread));
+}
+
+inline sampler& sampler::interval(std::chrono::microseconds interval)
+{
+    std::lock_guard<std::mutex> lock{m_mutex};
+    m_interval = interval;
+    m_effective_interval = interval;
+    return *this;
+}
+
+inline sampler& sampler::overhead_budget(double fraction)
+{
+    std::lock_guard<std::mutex> lock{m_mutex};
+    m_overhead_budget = fraction;
+    return *this;
+}
+
+inline sampler& sampler::frame_count(size_t count)
+{
+    std::lock_guard<std::mutex> lock{m_mutex};
+    m_frame_count = count;
+    return *this;
+}
+
+inline sampler& sampler::buffer_capacity(size_t samples)
+{
+    std::lock_guard<std::mutex> lock{m_mutex};
+    m_buffer_capacity = samples;
+    return *this;
+}
+
+inline bool sampler::start()
+{
+#ifndef _WIN32
+    if (!detail::install_sample_signal_handler())
+        return false;
+#endif
+
+    std::lock_guard<std::mutex> lock{m_mutex};
+
+    if (m_thread.joinable())
+        return true;
+
+    m_stopping = false;
+    m_thread = std::thread([this] { run(); });
+    return true;
+}
+
+inline void sampler::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock{m_mutex};
+        m_stopping = true;
+    }
+
+    m_wake.notify_all();
+
+    if (m_thread.joinable())
+        m_thread.join();
+}
+
+inline bool sampler::running() const
+{
+    std::lock_guard<std::mutex> lock{m_mutex};
+    return m_thread.joinable() && !m_stopping;
+}
+
+inline std::vector<aggregated_stack_trace> sampler::traces()
+{
+    {
+        // Samples of the last signals may have arrived after the sampler thread drained the buffers.
+        std::lock_guard<std::mutex> lock{m_mutex};
+        drain();
+    }
+
+    return m_aggregator.traces();
+}
+
+inline void sampler::write_collapsed(std::ostream& stream)
+{
+    // Stacks with different addresses in the same functions are one line of the collapsed format.
+    std::vector<std::pair<std::string, size_t>> lines;
+    std::unordered_map<std::string, size_t> line_indexes;
+    std::string line;
+    char number[20];
+
+    for (const auto& trace : traces())
+    {
+        line.clear();
+
+        // The addresses of a sample start at the interrupted function, and the collapsed format
+        // starts at the outermost function.
+        for (auto frame = trace.frames.rbegin(); frame != trace.frames.rend(); ++frame)
+        {
+            if (!line.empty())
+                line.push_back(';');
+
+            if (frame->function.empty())
+                line.append("0x").append(number, detail::format_number(frame->address, 16, number));
+            else
+                line.append(frame->function);
+        }
+
+        if (line.empty())
+            continue;
+
+        const auto found = line_indexes.emplace(line, lines.size());
+
+        if (found.second)
+            lines.emplace_back(line, trace.count);
+        else
+            lines[found.first->second].second += trace.count;
+    }
+
+    std::stable_sort(lines.begin(), lines.end(), [](const auto& a, const auto& b) { return a.second > b.second; });
+
+    for (auto& collapsed : lines)
+    {
+        collapsed.first.push_back(' ');
+        collapsed.first.append(number, detail::format_number(collapsed.second, 10, number));
+        collapsed.first.push_back('\n');
+        stream.write(collapsed.first.data(), static_cast<std::streamsize>(collapsed.first.size()));
+    }
+}
+
+inline sampler_statistics sampler::stats() const
+{
+    std::lock_guard<std::mutex> lock{m_mutex};
+    sampler_statistics statistics{m_samples, m_removed_dropped_samples, m_threads.size(), m_effective_interval};
+
+    for (const auto& thread : m_threads)
+        statistics.dropped_samples += thread->buffer().dropped();
+
+    return statistics;
+}
+
+inline void sampler::clear()
+{
+    std::lock_guard<std::mutex> lock{m_mutex};
+    drain();
+    m_aggregator.clear();
+    m_samples = 0;
+    m_removed_dropped_samples = 0;
+
+    for (const auto& thread : m_threads)
+        thread->buffer().take_cost_ns();
+}
+
+inline void sampler::run()
+{
+    std::unique_lock<std::mutex> lock{m_mutex};
+
+    while (!m_wake.wait_for(lock, m_effective_interval, [this] { return m_stopping; }))
+    {
+        // The samples of the previous round are aggregated before the next one is captured, which on
+        // POSIX gives the signal handlers an interval to complete.
+        const auto cost_ns = drain();
+        sample_threads();
+
+        // Each round captures a sample per thread, so the interval that keeps the capture time of
+        // a round within the budget is the capture time divided by the budget.
+        const auto cost = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::nanoseconds(cost_ns));
+        const auto budgeted = m_overhead_budget > 0 ? std::chrono::microseconds(static_cast<std::int64_t>(cost.count() / m_overhead_budget))
+                                                    : m_interval;
+        m_effective_interval = std::max(m_interval, budgeted);
+    }
+
+    drain();
+}
+
+inline void sampler::sample_threads()
+{
+#ifdef _WIN32
+    // Only the locks taken before suspending a thread can be taken while it's suspended, since it
+    // may hold any other lock, like the heap lock.
+#ifndef _M_X64
+    std::lock_guard<std::mutex> session_lock{detail::dbghlp_session::instance().mutex()};
+#endif
+
+    for (const auto& thread : m_threads)
+    {
+        auto& buffer = thread->buffer();
+        const auto start = std::chrono::steady_clock::now();
+
+        if (SuspendThread(thread->handle()) == static_cast<DWORD>(-1))
+            continue;
+
+        if (auto* sample = buffer.begin_write())
+        {
+            sample->count = detail::capture_thread_addresses(thread->handle(), sample->addresses.data(), buffer.frame_count());
+            ResumeThread(thread->handle());
+            buffer.end_write(static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count()));
+        }
+        else
+            ResumeThread(thread->handle());
+    }
+#else
+    for (const auto& thread : m_threads)
+        pthread_kill(thread->handle(), JG_SAMPLER_SIGNAL);
+#endif
+}
+
+// Aggregates the published samples, and returns the time that it took to capture them.
+inline std::uint64_t sampler::drain()
+{
+    std::uint64_t cost_ns = 0;
+
+    for (const auto& thread : m_threads)
+    {
+        auto& buffer = thread->buffer();
+
+        m_samples += buffer.drain([&](const detail::sample_buffer::sample& sample)
+        {
+            m_aggregator.add(sample.addresses.data(), sample.count);
+        });
+
+        cost_ns += buffer.take_cost_ns();
+    }
+
+    return cost_ns;
+}
+
+} // namespace jg
@@ -1,16 +1,42 @@
 #pragma once
 
+#include <array>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <thread>
 #include <vector>
+#include <unordered_map>
+#include <mutex>
 #include <string>
 #include <iostream>
+#include <memory>
+#include <cstddef>
 #include <cstdint>
+#include <cstring>
 
 #ifdef _WIN32
-#include <mutex>
 #include <process.h>
 #include <windows.h>
 #include <dbghelp.h>
 #pragma comment(lib, "dbghelp.lib")
+#else
+#include <cstdlib>
+#include <cxxabi.h>
+#include <dlfcn.h>
+#include <unwind.h>
+#ifdef __ELF__
+#include <elf.h>
+#include <fcntl.h>
+#include <link.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#elif defined(__APPLE__)
+#include <mach-o/dyld.h>
+#endif
 #endif
 
 //
@@ -20,6 +46,16 @@
 #error jg::stack_trace needs C++14 or newer
 #endif
 
+//
+// The functions that capture a stack trace must never be inlined, or the number of frames to skip
+// would depend on the optimization level.
+//
+#ifdef _MSC_VER
+#define JG_STACK_TRACE_NOINLINE __declspec(noinline)
+#else
+#define JG_STACK_TRACE_NOINLINE __attribute__((noinline))
+#endif
+
 namespace jg
 {
 
@@ -34,18 +70,156 @@ struct stack_frame final
     std::size_t line_displacement;
 };
 
-static inline std::ostream& operator<<(std::ostream& stream, const stack_frame& frame)
+namespace detail
 {
-    stream << "\t"
-           << frame.function
-           << " [0x" << std::hex << frame.address << " + 0x" << frame.address_displacement << "]";
-    
+
+inline size_t format_number(std::uint64_t value, unsigned base, char* digits)
+{
+    char reversed[20];
+    size_t count = 0;
+
+    do
+    {
+        reversed[count++] = "0123456789abcdef"[value % base];
+        value /= base;
+    }
+    while (value);
+
+    for (size_t i = 0; i < count; ++i)
+        digits[i] = reversed[count - 1 - i];
+
+    return count;
+}
+
+// Formats `frame` as a sequence of `append(const char* chars, size_t count)` calls, with no
+// allocations and no dependency on stream state.
+template <typename Append>
+void format_stack_frame(const stack_frame& frame, Append&& append)
+{
+    char number[20];
+
+    append("\t", 1);
+    append(frame.function.data(), frame.function.size());
+    append(" [0x", 4);
+    append(number, format_number(frame.address, 16, number));
+    append(" + 0x", 5);
+    append(number, format_number(frame.address_displacement, 16, number));
+    append("]", 1);
+
     if (!frame.file.empty())
-        stream << " at " << frame.file << "(" << std::dec << frame.line << ")";
+    {
+        append(" at ", 4);
+        append(frame.file.data(), frame.file.size());
+        append("(", 1);
+        append(number, format_number(frame.line, 10, number));
+        append(")", 1);
+    }
+}
+
+} // namespace detail
+
+/// Formats `frame` like `operator<<` does into `buffer`, which has room for `size` chars. The
+/// output is truncated if it doesn't fit, and it's always null terminated if `size` isn't 0.
+/// Returns the length of the untruncated output, like `std::snprintf`.
+inline size_t format_stack_frame(const stack_frame& frame, char* buffer, size_t size)
+{
+    size_t length = 0;
+
+    detail::format_stack_frame(frame, [&](const char* chars, size_t count)
+    {
+        if (length + 1 < size)
+            std::memcpy(buffer + length, chars, std::min(count, size - 1 - length));
+
+        length += count;
+    });
+
+    if (size)
+        buffer[std::min(length, size - 1)] = '\0';
+
+    return length;
+}
+
+/// Formats `frames` into `buffer` like `format_stack_frame()` does, with each frame followed by a
+/// newline. This renders a whole trace so that it can be output with a single write.
+inline size_t format_stack_trace(const std::vector<stack_frame>& frames, char* buffer, size_t size)
+{
+    size_t length = 0;
+
+    for (const auto& frame : frames)
+    {
+        length += format_stack_frame(frame, length < size ? buffer + length : nullptr, length < size ? size - length : 0);
+
+        if (length + 1 < size)
+            buffer[length] = '\n';
+
+        length++;
+    }
+
+    if (size)
+        buffer[std::min(length, size - 1)] = '\0';
+
+    return length;
+}
+
+/// Appends `frames` to `output` like the buffer overload does. Appending to a reused string only
+/// allocates when it has to grow.
+inline void format_stack_trace(const std::vector<stack_frame>& frames, std::string& output)
+{
+    for (const auto& frame : frames)
+    {
+        detail::format_stack_frame(frame, [&](const char* chars, size_t count) { output.append(chars, count); });
+        output.push_back('\n');
+    }
+}
+
+static inline std::ostream& operator<<(std::ostream& stream, const stack_frame& frame)
+{
+    detail::format_stack_frame(frame, [&](const char* chars, size_t count)
+    {
+        stream.write(chars, static_cast<std::streamsize>(count));
+    });
 
     return stream;
 }
 
+/// Resolves `count` instruction addresses, typically from a `jg::raw_stack_trace`, into stack frames.
+/// Addresses that can't be resolved are left out.
+inline std::vector<stack_frame> symbolize(void* const* addresses, size_t count);
+
+/// The instruction addresses of a captured stack trace, without any symbol information.
+///
+/// Capturing a `jg::raw_stack_trace` is cheap, since it's a fixed-size array of addresses that's
+/// never allocated. Resolving it into `jg::stack_frame`s is expensive and is only done on demand by
+/// `resolve()`, which makes it possible to capture at every suspicious event and only pay for the
+/// symbol lookups of the traces that are actually needed.
+///
+/// @example
+///     const auto raw_trace = jg::stack_trace().include_frame_count(25).capture_raw();
+///     ...
+///     if (broken_invariant)
+///         for (const auto& stack_frame : raw_trace.resolve())
+///             std::cout << stack_frame << "\n";
+class raw_stack_trace final
+{
+public:
+    static constexpr size_t max_frame_count = 64;
+
+    size_t size() const { return m_size; }
+    bool empty() const { return m_size == 0; }
+
+    void* const* begin() const { return m_addresses.data(); }
+    void* const* end() const { return m_addresses.data() + m_size; }
+    void* operator[](size_t index) const { return m_addresses[index]; }
+
+    std::vector<stack_frame> resolve() const { return symbolize(m_addresses.data(), m_size); }
+
+private:
+    friend class stack_trace;
+
+    std::array<void*, max_frame_count> m_addresses{};
+    size_t m_size = 0;
+};
+
 /// @example
 ///     if (broken_invariant)
 ///        for (const auto& stack_frame :
@@ -57,9 +231,48 @@ public:
     stack_trace& skip_frame_count(size_t count);
     stack_trace& include_frame_count(size_t count);
 
+    /// Captures and resolves the stack trace.
     std::vector<stack_frame> capture() const;
 
+    /// Captures the stack trace without resolving it. At most `jg::raw_stack_trace::max_frame_count`
+    /// frames are included.
+    raw_stack_trace capture_raw() const;
+
+    /// Captures the instruction addresses of the stack trace into `addresses`, which has room for
+    /// `capacity` addresses, and returns the number of captured addresses. They can be resolved
+    /// later with `jg::symbolize()`.
+    ///
+    /// This function, like `capture_raw()`, never allocates or locks, so it can be used in crash and
+    /// signal handlers, and in real-time threads. On POSIX platforms the stack is walked with
+    /// `_Unwind_Backtrace` by default, which is safe to use in a signal handler with the unwinders of
+    /// current toolchains (glibc 2.35 or newer on Linux). Defining JG_STACK_TRACE_USE_FRAME_POINTERS
+    /// walks the frame pointer chain instead, which makes no library calls at all, but requires the
+    /// code to be built with `-fno-omit-frame-pointer`.
+    ///
+    /// @example
+    ///     void* g_crash_addresses[32];
+    ///     size_t g_crash_frame_count = 0;
+    ///
+    ///     void on_signal(int)
+    ///     {
+    ///         // Symbolized later with jg::symbolize(g_crash_addresses, g_crash_frame_count).
+    ///         g_crash_frame_count = jg::stack_trace().include_frame_count(32).capture(g_crash_addresses, 32);
+    ///     }
+    size_t capture(void** addresses, size_t capacity) const;
+
+    /// Captures the stack trace without locking and hands it over to a background symbolizer thread,
+    /// so that many threads capturing at the same time don't queue up behind the platform symbol
+    /// lookup lock. The returned future gets the resolved stack frames. At most
+    /// `jg::raw_stack_trace::max_frame_count` frames are included.
+    std::future<std::vector<stack_frame>> capture_async() const;
+
+    /// Like the overload returning a future, but `callback` is invoked on the background symbolizer
+    /// thread with the resolved stack frames.
+    void capture_async(std::function<void(std::vector<stack_frame>)> callback) const;
+
 private:
+    size_t raw_capacity() const;
+
     size_t m_skip_frame_count = 0;
     size_t m_include_frame_count = 0;
 };
@@ -76,67 +289,1504 @@ inline stack_trace& stack_trace::include_frame_count(size_t count)
     return *this;
 }
 
-inline std::vector<stack_frame> stack_trace::capture() const
+struct symbol_cache_statistics final
 {
-    std::vector<stack_frame> stack_frames;
-    
-#ifdef _WIN32
+    std::uint64_t hits;
+    std::uint64_t misses;
+    std::size_t size;
+    std::size_t capacity;
+};
 
-    std::vector<void*> back_trace(m_include_frame_count);
+/// Returns the hit/miss statistics of the process-wide address-to-symbol cache that is used by
+/// `jg::symbolize()`, and thereby by `jg::stack_trace::capture()` and `jg::raw_stack_trace::resolve()`.
+inline symbol_cache_statistics symbol_cache_stats();
+
+/// Removes all entries from the process-wide address-to-symbol cache. The statistics are kept.
+inline void clear_symbol_cache();
+
+namespace detail
+{
+
+// A bounded, process-wide cache of resolved stack frames keyed by instruction address, so that
+// repeated traces don't have to go through the (single threaded and expensive) platform symbol
+// lookup again. Addresses that couldn't be resolved are cached as well.
+//
+// The cache is split into shards with their own locks to keep contention low when many threads
+// symbolize at the same time. Each shard evicts with the CLOCK algorithm, which approximates LRU
+// without having to reorder anything on a hit.
+//
+// The total capacity can be changed by defining JG_STACK_TRACE_SYMBOL_CACHE_CAPACITY.
+class symbol_cache final
+{
+public:
+#ifdef JG_STACK_TRACE_SYMBOL_CACHE_CAPACITY
+    static constexpr size_t capacity = JG_STACK_TRACE_SYMBOL_CACHE_CAPACITY;
+#else
+    static constexpr size_t capacity = 4096;
+#endif
+    static constexpr size_t shard_count = 16;
+    static constexpr size_t shard_capacity = (capacity + shard_count - 1) / shard_count;
+
+    enum class lookup { miss, unresolved, resolved };
 
-    if (const auto frame_count = CaptureStackBackTrace(static_cast<DWORD>(m_skip_frame_count + 1),
-                                                       static_cast<DWORD>(back_trace.size()),
-                                                       back_trace.data(),
-                                                       nullptr))
+    static symbol_cache& instance()
     {
-        stack_frames.reserve(frame_count);
-        back_trace.resize(frame_count);
+        static symbol_cache cache;
+        return cache;
+    }
 
-        SYMBOL_INFO_PACKAGE sip{};
-        sip.si.SizeOfStruct = sizeof(sip.si);
-        sip.si.MaxNameLen   = sizeof(sip.name);
-        
-        // All Win32 Sym... DbgHlp functions are single threaded and need synchronization.
-        static std::mutex dbghlp_mutex;
-        std::lock_guard<std::mutex> dbghlp_lock{dbghlp_mutex};
-        
-        if (SymInitialize(GetCurrentProcess(), NULL, TRUE))
+    lookup find(const void* address, stack_frame& frame)
+    {
+        return shard_for(address).find(address, frame);
+    }
+
+    void insert(const void* address, const stack_frame* frame)
+    {
+        shard_for(address).insert(address, frame);
+    }
+
+    void clear()
+    {
+        for (auto& shard : m_shards)
+            shard.clear();
+    }
+
+    // Clears the cache if `generation`, which changes whenever a module is loaded or unloaded, isn't
+    // the one that the cached frames were resolved in. A module that's unloaded can be replaced by
+    // another one at the same addresses, and then its cached frames would be wrong.
+    void clear_if_modules_changed(std::uint64_t generation)
+    {
+        if (m_module_generation.load(std::memory_order_relaxed) != generation &&
+            m_module_generation.exchange(generation, std::memory_order_relaxed) != generation)
+            clear();
+    }
+
+    symbol_cache_statistics statistics()
+    {
+        symbol_cache_statistics statistics{};
+        statistics.capacity = shard_capacity * shard_count;
+
+        for (auto& shard : m_shards)
+            shard.add_statistics(statistics);
+
+        return statistics;
+    }
+
+private:
+    class shard final
+    {
+    public:
+        lookup find(const void* address, stack_frame& frame)
         {
-            for (void* raw_address : back_trace)
+            std::lock_guard<std::mutex> lock{m_mutex};
+
+            const auto found = m_index.find(address);
+
+            if (found == m_index.end())
             {
-                const DWORD64 address = reinterpret_cast<DWORD64>(raw_address);
-                DWORD64 symbol_displacement = 0;
+                m_misses++;
+                return lookup::miss;
+            }
 
-                if (SymFromAddr(GetCurrentProcess(), address, &symbol_displacement, &sip.si))
-                {
-                    jg::stack_frame frame{};
-                    frame.address              = sip.si.Address;
-                    frame.address_displacement = symbol_displacement;
-                    frame.package              = sip.name;
-                    frame.function             = sip.si.Name;
-
-                    DWORD line_displacement = 0;
-                    IMAGEHLP_LINE64 line{};
-                    line.SizeOfStruct = sizeof(line);
-                    
-                    if (SymGetLineFromAddr64(GetCurrentProcess(), address, &line_displacement, &line))
-                    {
-                        frame.file              = line.FileName;
-                        frame.line              = line.LineNumber;
-                        frame.line_displacement = line_displacement;
-                    }
+            m_hits++;
 
-                    stack_frames.push_back(std::move(frame));
+            auto& slot = m_slots[found->second];
+            slot.referenced = true;
+
+            if (!slot.resolved)
+                return lookup::unresolved;
+
+            frame = slot.frame;
+            return lookup::resolved;
+        }
+
+        void insert(const void* address, const stack_frame* frame)
+        {
+            std::lock_guard<std::mutex> lock{m_mutex};
+
+            const auto found = m_index.find(address);
+            size_t index = 0;
+
+            if (found != m_index.end())
+                index = found->second; // Resolved concurrently by another thread.
+            else if (m_slots.size() < shard_capacity)
+            {
+                index = m_slots.size();
+                m_slots.emplace_back();
+                m_index.emplace(address, index);
+            }
+            else
+            {
+                while (m_slots[m_hand].referenced)
+                {
+                    m_slots[m_hand].referenced = false;
+                    m_hand = (m_hand + 1) % shard_capacity;
                 }
+
+                index = m_hand;
+                m_hand = (m_hand + 1) % shard_capacity;
+                m_index.erase(m_slots[index].address);
+                m_index.emplace(address, index);
             }
 
-            SymCleanup(GetCurrentProcess());
+            auto& slot = m_slots[index];
+            slot.address    = address;
+            slot.referenced = true;
+            slot.resolved   = frame != nullptr;
+            slot.frame      = frame ? *frame : stack_frame{};
+        }
+
+        void clear()
+        {
+            std::lock_guard<std::mutex> lock{m_mutex};
+            m_slots.clear();
+            m_index.clear();
+            m_hand = 0;
+        }
+
+        void add_statistics(symbol_cache_statistics& statistics)
+        {
+            std::lock_guard<std::mutex> lock{m_mutex};
+            statistics.hits   += m_hits;
+            statistics.misses += m_misses;
+            statistics.size   += m_slots.size();
         }
+
+    private:
+        struct slot final
+        {
+            const void* address = nullptr;
+            bool referenced = false;
+            bool resolved = false;
+            stack_frame frame{};
+        };
+
+        std::mutex m_mutex;
+        std::vector<slot> m_slots;
+        std::unordered_map<const void*, size_t> m_index;
+        size_t m_hand = 0;
+        std::uint64_t m_hits = 0;
+        std::uint64_t m_misses = 0;
+    };
+
+    shard& shard_for(const void* address)
+    {
+        // Fibonacci hashing, since return addresses are aligned and clustered.
+        const auto key = static_cast<std::uint64_t>(reinterpret_cast<std::uintptr_t>(address));
+        return m_shards[(key * 0x9E3779B97F4A7C15ull) >> 60];
     }
 
-#endif
+    std::array<shard, shard_count> m_shards;
+    std::atomic<std::uint64_t> m_module_generation{0};
+};
 
-    return stack_frames;
+#ifdef _WIN32
+
+// A process-wide DbgHelp symbol session. `SymInitialize` enumerates and loads every module in the
+// process, so it's done lazily the first time a stack trace is captured and then reused for all
+// subsequent captures. `SymCleanup` is called once, when the process exits.
+//
+// All Win32 Sym... DbgHlp functions are single threaded and need synchronization, so any usage of
+// the session must be done while holding `mutex()`.
+class dbghlp_session final
+{
+public:
+    static dbghlp_session& instance()
+    {
+        static dbghlp_session session;
+        return session;
+    }
+
+    std::mutex& mutex() { return m_mutex; }
+    HANDLE process() const { return m_process; }
+    bool initialized() const { return m_initialized; }
+
+    // Modules loaded (or unloaded and then reloaded at another base address) after the session was
+    // initialized aren't known to DbgHelp. That's detected by comparing the module base that DbgHelp
+    // has for `address` with the base of the module that actually contains it, and only then is the
+    // module list refreshed.
+    void refresh_modules_for(DWORD64 address)
+    {
+        HMODULE module = nullptr;
+
+        if (!GetModuleHandleExW(GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS | GET_MODULE_HANDLE_EX_FLAG_UNCHANGED_REFCOUNT,
+                                reinterpret_cast<LPCWSTR>(address),
+                                &module))
+            return; // Not in a module at all (generated code, for instance), so nothing to refresh.
+
+        const DWORD64 module_base = reinterpret_cast<DWORD64>(module);
+        const DWORD64 known_base  = SymGetModuleBase64(m_process, address);
+
+        if (known_base == module_base)
+            return;
+        
+        if (known_base)
+            SymUnloadModule64(m_process, known_base); // A stale module that has been unloaded.
+
+        SymRefreshModuleList(m_process);
+
+        // Cached frames may belong to the modules that were unloaded.
+        symbol_cache::instance().clear();
+    }
+
+    dbghlp_session(const dbghlp_session&) = delete;
+    dbghlp_session& operator=(const dbghlp_session&) = delete;
+
+private:
+    dbghlp_session()
+        : m_process(GetCurrentProcess())
+    {
+        // Deferred loads make the initialization cheap, since symbols for a module are only loaded
+        // when an address in it is looked up for the first time.
+        SymSetOptions(SymGetOptions() | SYMOPT_DEFERRED_LOADS | SYMOPT_LOAD_LINES | SYMOPT_UNDNAME);
+        m_initialized = SymInitialize(m_process, NULL, TRUE) != FALSE;
+    }
+
+    ~dbghlp_session()
+    {
+        std::lock_guard<std::mutex> lock{m_mutex};
+
+        if (m_initialized)
+            SymCleanup(m_process);
+    }
+
+    std::mutex m_mutex;
+    HANDLE m_process;
+    bool m_initialized = false;
+};
+
+#else
+
+struct unwind_state final
+{
+    void** addresses;
+    size_t capacity;
+    size_t skip_frame_count;
+    size_t count;
+};
+
+inline _Unwind_Reason_Code unwind_callback(_Unwind_Context* context, void* data)
+{
+    auto& state = *static_cast<unwind_state*>(data);
+    const auto address = _Unwind_GetIP(context);
+
+    if (!address || state.count == state.capacity)
+        return _URC_END_OF_STACK;
+
+    if (state.skip_frame_count > 0)
+        state.skip_frame_count--;
+    else
+        state.addresses[state.count++] = reinterpret_cast<void*>(address);
+
+    return _URC_NO_REASON;
+}
+
+inline std::string demangle(const char* name)
+{
+    int status = 0;
+    char* demangled = abi::__cxa_demangle(name, nullptr, nullptr, &status);
+    std::string result = demangled ? demangled : name;
+
+    std::free(demangled);
+    return result;
+}
+
+#ifdef __ELF__
+
+// Bounds checked reading of ELF and DWARF data. Reading past the end sets `failed`, after which
+// everything reads as zero.
+struct byte_reader final
+{
+    const std::uint8_t* position;
+    const std::uint8_t* end;
+    bool failed = false;
+
+    bool at_end() const { return failed || position >= end; }
+
+    void skip(std::uint64_t count)
+    {
+        if (count > static_cast<std::uint64_t>(end - position))
+        {
+            position = end;
+            failed = true;
+        }
+        else
+            position += count;
+    }
+
+    template <typename T>
+    T read()
+    {
+        T value{};
+
+        if (sizeof(T) > static_cast<size_t>(end - position))
+        {
+            position = end;
+            failed = true;
+        }
+        else
+        {
+            std::memcpy(&value, position, sizeof(T));
+            position += sizeof(T);
+        }
+
+        return value;
+    }
+
+    std::uint64_t read_unsigned(size_t size)
+    {
+        switch (size)
+        {
+            case 1:  return read<std::uint8_t>();
+            case 2:  return read<std::uint16_t>();
+            case 4:  return read<std::uint32_t>();
+            case 8:  return read<std::uint64_t>();
+            default: skip(size); return 0;
+        }
+    }
+
+    std::uint64_t read_uleb128()
+    {
+        std::uint64_t value = 0;
+        unsigned shift = 0;
+        std::uint8_t byte = 0;
+
+        do
+        {
+            byte = read<std::uint8_t>();
+
+            if (shift < 64)
+                value |= static_cast<std::uint64_t>(byte & 0x7f) << shift;
+
+            shift += 7;
+        }
+        while ((byte & 0x80) && !failed);
+
+        return value;
+    }
+
+    std::int64_t read_sleb128()
+    {
+        std::uint64_t value = 0;
+        unsigned shift = 0;
+        std::uint8_t byte = 0;
+
+        do
+        {
+            byte = read<std::uint8_t>();
+
+            if (shift < 64)
+                value |= static_cast<std::uint64_t>(byte & 0x7f) << shift;
+
+            shift += 7;
+        }
+        while ((byte & 0x80) && !failed);
+
+        if (shift < 64 && (byte & 0x40))
+            value |= ~std::uint64_t{0} << shift;
+
+        return static_cast<std::int64_t>(value);
+    }
+
+    const char* read_string()
+    {
+        const auto* begin = position;
+        const auto* terminator = static_cast<const std::uint8_t*>(std::memchr(position, 0, end - position));
+
+        if (!terminator)
+        {
+            position = end;
+            failed = true;
+            return "";
+        }
+
+        position = terminator + 1;
+        return reinterpret_cast<const char*>(begin);
+    }
+};
+
+// Returns the GNU build id in a sequence of ELF notes, or an empty string if there isn't one.
+inline std::string find_gnu_build_id(const std::uint8_t* notes, size_t size)
+{
+    byte_reader reader{notes, notes + size};
+
+    while (!reader.at_end())
+    {
+        const auto name_size = reader.read<std::uint32_t>();
+        const auto description_size = reader.read<std::uint32_t>();
+        const auto type = reader.read<std::uint32_t>();
+        const auto* name = reader.position;
+        reader.skip((name_size + 3) & ~3u);
+        const auto* description = reader.position;
+        reader.skip((description_size + 3) & ~3u);
+
+        if (!reader.failed && type == NT_GNU_BUILD_ID && name_size == 4 && std::memcmp(name, "GNU", 4) == 0)
+            return std::string(reinterpret_cast<const char*>(description), description_size);
+    }
+
+    return {};
+}
+
+struct elf_section final
+{
+    const std::uint8_t* data = nullptr;
+    size_t size = 0;
+
+    const char* string_at(std::uint64_t offset) const
+    {
+        if (offset >= size || !std::memchr(data + offset, 0, size - offset))
+            return "";
+
+        return reinterpret_cast<const char*>(data + offset);
+    }
+};
+
+// Symbol and source line information for one loaded ELF module, parsed from its `.symtab` (or
+// `.dynsym`) and `.debug_line` sections once, the first time an address in the module is resolved.
+// Addresses are relative to the module's load bias.
+class elf_module_info final
+{
+public:
+    elf_module_info(std::string path)
+        : m_path(std::move(path))
+    {
+        const int file = ::open(m_path.c_str(), O_RDONLY | O_CLOEXEC);
+
+        if (file < 0)
+            return;
+
+        struct stat status{};
+
+        if (::fstat(file, &status) == 0 && status.st_size > 0)
+        {
+            const auto size = static_cast<size_t>(status.st_size);
+
+            void* image = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, file, 0);
+
+            if (image != MAP_FAILED)
+            {
+                parse(static_cast<const std::uint8_t*>(image), size);
+                ::munmap(image, size);
+            }
+        }
+
+        ::close(file);
+    }
+
+    const std::string& path() const { return m_path; }
+    const std::string& build_id() const { return m_build_id; }
+
+    // Resolves the return address `address` in the module, when it's loaded with `load_bias`. The
+    // source line is resolved even if the function isn't, but `true` is only returned if the
+    // function is.
+    bool resolve(std::uintptr_t address, std::uintptr_t load_bias, stack_frame& frame) const
+    {
+        // Return addresses point at the instruction after the call, which may belong to the next line.
+        const std::uint64_t call_address = address - load_bias - 1;
+
+        std::uint64_t line_address = 0;
+        size_t line = 0;
+
+        if (const char* file = find_line(call_address, line_address, line))
+        {
+            frame.file              = file;
+            frame.line              = line;
+            frame.line_displacement = call_address + 1 - line_address;
+        }
+
+        std::uint64_t function_address = 0;
+        const char* function = find_function(call_address, function_address);
+
+        if (!function)
+            return false;
+
+        frame.address              = load_bias + function_address;
+        frame.address_displacement = address - frame.address;
+        frame.package              = m_path;
+        frame.function             = demangle(function);
+
+        return true;
+    }
+
+    // Returns the name of the function containing `address`, or nullptr.
+    const char* find_function(std::uint64_t address, std::uint64_t& function_address) const
+    {
+        auto found = std::upper_bound(m_symbols.begin(), m_symbols.end(), address,
+                                      [](std::uint64_t a, const symbol& s) { return a < s.address; });
+
+        if (found == m_symbols.begin())
+            return nullptr;
+
+        --found;
+
+        if (found->size && address >= found->address + found->size)
+            return nullptr;
+
+        function_address = found->address;
+        return m_names.c_str() + found->name;
+    }
+
+    // Returns the source file containing `address`, or nullptr.
+    const char* find_line(std::uint64_t address, std::uint64_t& line_address, size_t& line) const
+    {
+        auto found = std::upper_bound(m_rows.begin(), m_rows.end(), address,
+                                      [](std::uint64_t a, const line_row& r) { return a < r.address; });
+
+        if (found == m_rows.begin())
+            return nullptr;
+
+        --found;
+
+        if (found->end_sequence || found->file >= m_files.size())
+            return nullptr;
+
+        line_address = found->address;
+        line = found->line;
+        return m_files[found->file].c_str();
+    }
+
+private:
+    struct symbol final
+    {
+        std::uint64_t address;
+        std::uint64_t size;
+        std::uint32_t name;
+    };
+
+    struct line_row final
+    {
+        std::uint64_t address;
+        std::uint32_t file;
+        std::uint32_t line;
+        bool end_sequence;
+    };
+
+    void parse(const std::uint8_t* image, size_t size)
+    {
+        if (size < sizeof(ElfW(Ehdr)) || std::memcmp(image, ELFMAG, SELFMAG) != 0)
+            return;
+
+        ElfW(Ehdr) header;
+        std::memcpy(&header, image, sizeof(header));
+
+        if (header.e_ident[EI_CLASS] != (sizeof(void*) == 8 ? ELFCLASS64 : ELFCLASS32) ||
+            header.e_shentsize != sizeof(ElfW(Shdr)) ||
+            header.e_shoff > size ||
+            header.e_shnum > (size - header.e_shoff) / sizeof(ElfW(Shdr)) ||
+            header.e_shstrndx >= header.e_shnum)
+            return;
+
+        std::vector<ElfW(Shdr)> sections(header.e_shnum);
+        std::memcpy(sections.data(), image + header.e_shoff, sections.size() * sizeof(ElfW(Shdr)));
+
+        const auto section_data = [&](const ElfW(Shdr)& section)
+        {
+            elf_section result;
+
+            if (section.sh_type != SHT_NOBITS && !(section.sh_flags & SHF_COMPRESSED) &&
+                section.sh_offset <= size && section.sh_size <= size - section.sh_offset)
+            {
+                result.data = image + section.sh_offset;
+                result.size = section.sh_size;
+            }
+
+            return result;
+        };
+
+        const auto section_names = section_data(sections[header.e_shstrndx]);
+        const ElfW(Shdr)* symtab = nullptr;
+        const ElfW(Shdr)* dynsym = nullptr;
+        elf_section debug_line, debug_line_str, debug_str;
+
+        for (const auto& section : sections)
+        {
+            const std::string name = section_names.string_at(section.sh_name);
+
+            if (section.sh_type == SHT_SYMTAB)
+                symtab = &section;
+            else if (section.sh_type == SHT_DYNSYM)
+                dynsym = &section;
+            else if (name == ".debug_line")
+                debug_line = section_data(section);
+            else if (name == ".debug_line_str")
+                debug_line_str = section_data(section);
+            else if (name == ".debug_str")
+                debug_str = section_data(section);
+            else if (section.sh_type == SHT_NOTE && m_build_id.empty())
+            {
+                const auto notes = section_data(section);
+                m_build_id = find_gnu_build_id(notes.data, notes.size);
+            }
+        }
+
+        if (const auto* symbols = symtab ? symtab : dynsym)
+            if (symbols->sh_link < sections.size())
+                parse_symbols(section_data(*symbols), section_data(sections[symbols->sh_link]));
+
+        if (debug_line.data)
+            parse_lines(debug_line, debug_line_str, debug_str);
+    }
+
+    void parse_symbols(elf_section symbols, elf_section names)
+    {
+        const size_t count = symbols.size / sizeof(ElfW(Sym));
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            ElfW(Sym) entry;
+            std::memcpy(&entry, symbols.data + i * sizeof(entry), sizeof(entry));
+
+            const auto type = entry.st_info & 0xf;
+
+            if ((type != STT_FUNC && type != STT_GNU_IFUNC) || entry.st_shndx == SHN_UNDEF || !entry.st_value)
+                continue;
+
+            m_symbols.push_back({entry.st_value, entry.st_size, static_cast<std::uint32_t>(m_names.size())});
+            m_names.append(names.string_at(entry.st_name)).push_back('\0');
+        }
+
+        std::sort(m_symbols.begin(), m_symbols.end(),
+                  [](const symbol& a, const symbol& b) { return a.address < b.address; });
+    }
+
+    void parse_lines(elf_section debug_line, elf_section debug_line_str, elf_section debug_str)
+    {
+        std::unordered_map<std::string, std::uint32_t> file_ids;
+        byte_reader reader{debug_line.data, debug_line.data + debug_line.size};
+
+        while (!reader.at_end())
+        {
+            std::uint64_t unit_length = reader.read<std::uint32_t>();
+            const bool dwarf64 = unit_length == 0xffffffff;
+
+            if (dwarf64)
+                unit_length = reader.read<std::uint64_t>();
+
+            if (reader.failed || unit_length > static_cast<std::uint64_t>(reader.end - reader.position))
+                break;
+
+            byte_reader unit{reader.position, reader.position + unit_length};
+            reader.skip(unit_length);
+
+            parse_line_unit(unit, dwarf64, debug_line_str, debug_str, file_ids);
+        }
+
+        // At equal addresses, the end of a sequence comes before the start of the next one.
+        std::sort(m_rows.begin(), m_rows.end(), [](const line_row& a, const line_row& b)
+        {
+            return a.address < b.address || (a.address == b.address && a.end_sequence && !b.end_sequence);
+        });
+    }
+
+    std::uint32_t file_id(std::string name, std::unordered_map<std::string, std::uint32_t>& file_ids)
+    {
+        const auto inserted = file_ids.emplace(std::move(name), static_cast<std::uint32_t>(m_files.size()));
+
+        if (inserted.second)
+            m_files.push_back(inserted.first->first);
+
+        return inserted.first->second;
+    }
+
+    static std::string join_path(const std::string& directory, const char* name)
+    {
+        if (directory.empty() || name[0] == '/')
+            return name;
+
+        return directory + "/" + name;
+    }
+
+    void parse_line_unit(byte_reader& unit,
+                         bool dwarf64,
+                         elf_section debug_line_str,
+                         elf_section debug_str,
+                         std::unordered_map<std::string, std::uint32_t>& file_ids)
+    {
+        const auto version = unit.read<std::uint16_t>();
+
+        if (version < 2 || version > 5)
+            return;
+
+        if (version >= 5)
+            unit.skip(2); // address_size and segment_selector_size
+
+        const auto header_length = unit.read_unsigned(dwarf64 ? 8 : 4);
+
+        if (header_length > static_cast<std::uint64_t>(unit.end - unit.position))
+            return;
+
+        const auto* program = unit.position + header_length;
+        const auto minimum_instruction_length = unit.read<std::uint8_t>();
+
+        if (version >= 4)
+            unit.skip(1); // maximum_operations_per_instruction
+
+        const bool default_is_stmt = unit.read<std::uint8_t>() != 0;
+        const auto line_base = unit.read<std::int8_t>();
+        const auto line_range = unit.read<std::uint8_t>();
+        const auto opcode_base = unit.read<std::uint8_t>();
+
+        if (unit.failed || line_range == 0 || opcode_base == 0)
+            return;
+
+        std::array<std::uint8_t, 256> standard_opcode_lengths{};
+
+        for (size_t i = 1; i < opcode_base; ++i)
+            standard_opcode_lengths[i] = unit.read<std::uint8_t>();
+
+        std::vector<std::string> directories;
+        std::vector<std::uint32_t> files;
+        const auto invalid_file = static_cast<std::uint32_t>(-1);
+
+        if (version < 5)
+        {
+            directories.emplace_back(); // The compilation directory isn't in the line program header.
+
+            while (!unit.at_end() && *unit.position)
+                directories.emplace_back(unit.read_string());
+
+            unit.skip(1);
+            files.push_back(invalid_file); // File numbers are 1-based.
+
+            while (!unit.at_end() && *unit.position)
+            {
+                const char* name = unit.read_string();
+                const auto directory = unit.read_uleb128();
+                unit.read_uleb128(); // modification time
+                unit.read_uleb128(); // file length
+
+                files.push_back(file_id(join_path(directory < directories.size() ? directories[directory] : "", name), file_ids));
+            }
+        }
+        else
+        {
+            const auto read_entries = [&](auto&& add_entry)
+            {
+                std::vector<std::pair<std::uint64_t, std::uint64_t>> formats(unit.read<std::uint8_t>());
+
+                for (auto& format : formats)
+                {
+                    format.first  = unit.read_uleb128();
+                    format.second = unit.read_uleb128();
+                }
+
+                for (auto count = unit.read_uleb128(); count > 0 && !unit.at_end(); --count)
+                {
+                    const char* path = "";
+                    std::uint64_t directory = 0;
+
+                    for (const auto& format : formats)
+                    {
+                        const char* string = nullptr;
+                        std::uint64_t number = 0;
+
+                        if (!read_form(unit, format.second, dwarf64, debug_line_str, debug_str, string, number))
+                            return false;
+
+                        if (format.first == 1 && string) // DW_LNCT_path
+                            path = string;
+                        else if (format.first == 2) // DW_LNCT_directory_index
+                            directory = number;
+                    }
+
+                    add_entry(path, directory);
+                }
+
+                return !unit.failed;
+            };
+
+            if (!read_entries([&](const char* path, std::uint64_t) { directories.emplace_back(path); }))
+                return;
+
+            if (!read_entries([&](const char* path, std::uint64_t directory)
+                {
+                    files.push_back(file_id(join_path(directory < directories.size() ? directories[directory] : "", path), file_ids));
+                }))
+                return;
+        }
+
+        (void)default_is_stmt;
+        unit.position = program;
+
+        std::uint64_t address = 0;
+        std::uint64_t file = 1;
+        std::int64_t line = 1;
+
+        const auto emit_row = [&](bool end_sequence)
+        {
+            m_rows.push_back({address,
+                              file < files.size() ? files[file] : invalid_file,
+                              static_cast<std::uint32_t>(line),
+                              end_sequence});
+        };
+
+        while (!unit.at_end())
+        {
+            const auto opcode = unit.read<std::uint8_t>();
+
+            if (opcode >= opcode_base)
+            {
+                const auto adjusted = opcode - opcode_base;
+                address += (adjusted / line_range) * minimum_instruction_length;
+                line += line_base + adjusted % line_range;
+                emit_row(false);
+                continue;
+            }
+
+            switch (opcode)
+            {
+                case 0: // Extended opcode
+                {
+                    const auto length = unit.read_uleb128();
+                    const auto* next = unit.position + std::min<std::uint64_t>(length, unit.end - unit.position);
+
+                    switch (length ? unit.read<std::uint8_t>() : 0)
+                    {
+                        case 1: // DW_LNE_end_sequence
+                            emit_row(true);
+                            address = 0;
+                            file = 1;
+                            line = 1;
+                            break;
+                        case 2: // DW_LNE_set_address
+                            address = unit.read_unsigned(static_cast<size_t>(length - 1));
+                            break;
+                        default:
+                            break;
+                    }
+
+                    unit.position = next;
+                    break;
+                }
+                case 1: // DW_LNS_copy
+                    emit_row(false);
+                    break;
+                case 2: // DW_LNS_advance_pc
+                    address += unit.read_uleb128() * minimum_instruction_length;
+                    break;
+                case 3: // DW_LNS_advance_line
+                    line += unit.read_sleb128();
+                    break;
+                case 4: // DW_LNS_set_file
+                    file = unit.read_uleb128();
+                    break;
+                case 8: // DW_LNS_const_add_pc
+                    address += ((255 - opcode_base) / line_range) * minimum_instruction_length;
+                    break;
+                case 9: // DW_LNS_fixed_advance_pc
+                    address += unit.read<std::uint16_t>();
+                    break;
+                default: // Opcodes with operands that don't affect the address to line mapping.
+                    for (size_t i = 0; i < standard_opcode_lengths[opcode]; ++i)
+                        unit.read_uleb128();
+                    break;
+            }
+        }
+    }
+
+    static bool read_form(byte_reader& reader,
+                          std::uint64_t form,
+                          bool dwarf64,
+                          elf_section debug_line_str,
+                          elf_section debug_str,
+                          const char*& string,
+                          std::uint64_t& number)
+    {
+        switch (form)
+        {
+            case 0x08: string = reader.read_string(); break;                                           // DW_FORM_string
+            case 0x0e: string = debug_str.string_at(reader.read_unsigned(dwarf64 ? 8 : 4)); break;      // DW_FORM_strp
+            case 0x1f: string = debug_line_str.string_at(reader.read_unsigned(dwarf64 ? 8 : 4)); break; // DW_FORM_line_strp
+            case 0x0b: number = reader.read<std::uint8_t>(); break;                                    // DW_FORM_data1
+            case 0x05: number = reader.read<std::uint16_t>(); break;                                   // DW_FORM_data2
+            case 0x06: number = reader.read<std::uint32_t>(); break;                                   // DW_FORM_data4
+            case 0x07: number = reader.read<std::uint64_t>(); break;                                   // DW_FORM_data8
+            case 0x0f: number = reader.read_uleb128(); break;                                          // DW_FORM_udata
+            case 0x1e: reader.skip(16); break;                                                         // DW_FORM_data16
+            case 0x09: reader.skip(reader.read_uleb128()); break;                                      // DW_FORM_block
+            default: return false;
+        }
+
+        return !reader.failed;
+    }
+
+    std::string m_path;
+    std::string m_build_id;
+    std::vector<symbol> m_symbols;
+    std::string m_names;
+    std::vector<line_row> m_rows;
+    std::vector<std::string> m_files;
+};
+
+struct loaded_module final
+{
+    std::uintptr_t address;
+    std::uintptr_t load_bias = 0;
+    const char* path = nullptr;
+};
+
+inline int find_loaded_module(dl_phdr_info* info, size_t, void* data)
+{
+    auto& module = *static_cast<loaded_module*>(data);
+
+    for (size_t i = 0; i < info->dlpi_phnum; ++i)
+    {
+        const auto& segment = info->dlpi_phdr[i];
+        const auto begin = info->dlpi_addr + segment.p_vaddr;
+
+        if (segment.p_type == PT_LOAD && module.address >= begin && module.address < begin + segment.p_memsz)
+        {
+            module.load_bias = info->dlpi_addr;
+            module.path = (info->dlpi_name && *info->dlpi_name) ? info->dlpi_name : "/proc/self/exe";
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+// Only looks at the first module, since the load and unload counts are the same in every one.
+inline int read_module_generation(dl_phdr_info* info, size_t size, void* data)
+{
+    if (size >= offsetof(dl_phdr_info, dlpi_subs) + sizeof(info->dlpi_subs))
+        *static_cast<std::uint64_t*>(data) = static_cast<std::uint64_t>(info->dlpi_adds + info->dlpi_subs);
+
+    return 1;
+}
+
+// A number that changes whenever a module is loaded or unloaded, see `symbol_cache`.
+inline std::uint64_t loaded_module_generation()
+{
+    std::uint64_t generation = 0;
+    dl_iterate_phdr(read_module_generation, &generation);
+    return generation;
+}
+
+#elif defined(__APPLE__)
+
+inline std::atomic<std::uint64_t>& dyld_image_changes()
+{
+    static std::atomic<std::uint64_t> changes{0};
+    return changes;
+}
+
+inline void count_dyld_image_change(const mach_header*, intptr_t)
+{
+    dyld_image_changes().fetch_add(1, std::memory_order_relaxed);
+}
+
+// A number that changes whenever a module is loaded or unloaded, see `symbol_cache`.
+inline std::uint64_t loaded_module_generation()
+{
+    static const bool registered = (_dyld_register_func_for_add_image(count_dyld_image_change),
+                                    _dyld_register_func_for_remove_image(count_dyld_image_change),
+                                    true);
+    (void)registered;
+    return dyld_image_changes().load(std::memory_order_relaxed);
+}
+
+#else
+
+inline std::uint64_t loaded_module_generation()
+{
+    return 0;
+}
+
+#endif
+
+// The POSIX counterpart of the DbgHelp session: the parsed debug information of every module that
+// has been symbolized, keyed by load bias, so that only the first lookup in a module pays for
+// reading it. A module that has been unloaded and replaced by another one at the same load bias is
+// detected by its path and parsed again.
+//
+// Any usage of the registry must be done while holding `mutex()`.
+class module_registry final
+{
+public:
+    static module_registry& instance()
+    {
+        static module_registry registry;
+        return registry;
+    }
+
+    std::mutex& mutex() { return m_mutex; }
+
+    bool resolve_frame(const void* raw_address, stack_frame& frame)
+    {
+        const auto address = reinterpret_cast<std::uintptr_t>(raw_address);
+
+#ifdef __ELF__
+        loaded_module module{address - 1};
+
+        if (dl_iterate_phdr(find_loaded_module, &module))
+        {
+            auto& info = m_modules[module.load_bias];
+
+            if (!info || info->path() != module.path)
+                info = std::make_unique<elf_module_info>(module.path);
+
+            if (info->resolve(address, module.load_bias, frame))
+                return true;
+        }
+#endif
+
+        // Exported symbols only, but works without any debug information parsing.
+        Dl_info dl_info{};
+
+        if (!dladdr(raw_address, &dl_info) || !dl_info.dli_sname)
+            return false;
+
+        frame.address              = reinterpret_cast<std::uintptr_t>(dl_info.dli_saddr);
+        frame.address_displacement = address - frame.address;
+        frame.package              = dl_info.dli_fname ? dl_info.dli_fname : "";
+        frame.function             = demangle(dl_info.dli_sname);
+
+        return true;
+    }
+
+    module_registry(const module_registry&) = delete;
+    module_registry& operator=(const module_registry&) = delete;
+
+private:
+    module_registry() = default;
+
+    std::mutex m_mutex;
+#ifdef __ELF__
+    std::unordered_map<std::uintptr_t, std::unique_ptr<elf_module_info>> m_modules;
+#endif
+};
+
+#endif
+
+// Captures at most `capacity` instruction addresses of the calling thread's stack into `addresses`,
+// after skipping the `skip_frame_count` innermost frames (not counting this function's own frame).
+// Never allocates or locks.
+//
+// The number of captured addresses is returned through `count` rather than the return value, since
+// a caller that returned it directly could be tail call optimized, and its frame wouldn't be skipped.
+JG_STACK_TRACE_NOINLINE inline void capture_addresses(void** addresses, size_t capacity, size_t skip_frame_count, size_t& count)
+{
+    count = 0;
+
+    if (capacity == 0)
+        return;
+
+#if defined(_WIN32)
+
+    count = CaptureStackBackTrace(static_cast<DWORD>(skip_frame_count + 1),
+                                  static_cast<DWORD>(capacity),
+                                  addresses,
+                                  nullptr);
+
+#elif defined(JG_STACK_TRACE_USE_FRAME_POINTERS)
+
+    // Each frame record starts with the caller's frame pointer, followed by the return address into
+    // the caller. The first return address is already in the caller of this function. The walk stops
+    // at anything that doesn't look like an older frame on the same stack.
+    auto** frame = static_cast<void**>(__builtin_frame_address(0));
+
+    while (frame && count < capacity)
+    {
+        if (!frame[1])
+            break;
+
+        if (skip_frame_count > 0)
+            skip_frame_count--;
+        else
+            addresses[count++] = frame[1];
+
+        auto** caller_frame = static_cast<void**>(frame[0]);
+
+        if (caller_frame <= frame ||
+            reinterpret_cast<std::uintptr_t>(caller_frame) - reinterpret_cast<std::uintptr_t>(frame) > 0x100000 ||
+            reinterpret_cast<std::uintptr_t>(caller_frame) % sizeof(void*) != 0)
+            break;
+
+        frame = caller_frame;
+    }
+
+#else
+
+    unwind_state state{addresses, capacity, skip_frame_count + 1, 0};
+    _Unwind_Backtrace(unwind_callback, &state);
+    count = state.count;
+
+#endif
+}
+
+} // namespace detail
+
+JG_STACK_TRACE_NOINLINE inline std::vector<stack_frame> stack_trace::capture() const
+{
+    std::vector<void*> back_trace(m_include_frame_count);
+    size_t count = 0;
+    detail::capture_addresses(back_trace.data(), back_trace.size(), m_skip_frame_count + 1, count);
+
+    return symbolize(back_trace.data(), count);
+}
+
+JG_STACK_TRACE_NOINLINE inline raw_stack_trace stack_trace::capture_raw() const
+{
+    raw_stack_trace trace;
+    detail::capture_addresses(trace.m_addresses.data(), raw_capacity(), m_skip_frame_count + 1, trace.m_size);
+    return trace;
+}
+
+JG_STACK_TRACE_NOINLINE inline size_t stack_trace::capture(void** addresses, size_t capacity) const
+{
+    size_t count = 0;
+    detail::capture_addresses(addresses,
+                              m_include_frame_count < capacity ? m_include_frame_count : capacity,
+                              m_skip_frame_count + 1,
+                              count);
+    return count;
+}
+
+namespace detail
+{
+
+#ifdef _WIN32
+
+// Must be called while holding the session lock. `process` is the current process for the session,
+// or a handle identifying an offline symbol session.
+inline bool resolve_frame(HANDLE process, DWORD64 address, stack_frame& frame)
+{
+    SYMBOL_INFO_PACKAGE sip{};
+    sip.si.SizeOfStruct = sizeof(sip.si);
+    sip.si.MaxNameLen   = sizeof(sip.name);
+
+    DWORD64 symbol_displacement = 0;
+
+    if (!SymFromAddr(process, address, &symbol_displacement, &sip.si))
+        return false;
+
+    frame.address              = sip.si.Address;
+    frame.address_displacement = symbol_displacement;
+    frame.package              = sip.name;
+    frame.function             = sip.si.Name;
+
+    DWORD line_displacement = 0;
+    IMAGEHLP_LINE64 line{};
+    line.SizeOfStruct = sizeof(line);
+    
+    if (SymGetLineFromAddr64(process, address, &line_displacement, &line))
+    {
+        frame.file              = line.FileName;
+        frame.line              = line.LineNumber;
+        frame.line_displacement = line_displacement;
+    }
+
+    return true;
+}
+
+#endif
+
+// Constructs the singletons used by symbolization. An object that symbolizes on a thread of its own
+// calls this before starting the thread, so that it's destroyed before the singletons at exit.
+inline void construct_symbolization_singletons()
+{
+    symbol_cache::instance();
+#ifdef _WIN32
+    dbghlp_session::instance();
+#else
+    module_registry::instance();
+#endif
+}
+
+// Resolves the addresses that weren't found in the symbol cache and adds them to it.
+inline void resolve_cache_misses(void* const* addresses, size_t count, symbol_cache::lookup* lookups, stack_frame* frames)
+{
+#ifdef _WIN32
+
+    auto& cache = symbol_cache::instance();
+    auto& session = dbghlp_session::instance();
+    std::lock_guard<std::mutex> dbghlp_lock{session.mutex()};
+    
+    if (!session.initialized())
+        return;
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (lookups[i] != symbol_cache::lookup::miss)
+            continue;
+
+        const DWORD64 address = reinterpret_cast<DWORD64>(addresses[i]);
+        session.refresh_modules_for(address);
+
+        if (resolve_frame(session.process(), address, frames[i]))
+        {
+            lookups[i] = symbol_cache::lookup::resolved;
+            cache.insert(addresses[i], &frames[i]);
+        }
+        else
+        {
+            lookups[i] = symbol_cache::lookup::unresolved;
+            cache.insert(addresses[i], nullptr);
+        }
+    }
+
+#else
+
+    auto& cache = symbol_cache::instance();
+    auto& registry = module_registry::instance();
+    std::lock_guard<std::mutex> registry_lock{registry.mutex()};
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (lookups[i] != symbol_cache::lookup::miss)
+            continue;
+
+        if (registry.resolve_frame(addresses[i], frames[i]))
+        {
+            lookups[i] = symbol_cache::lookup::resolved;
+            cache.insert(addresses[i], &frames[i]);
+        }
+        else
+        {
+            lookups[i] = symbol_cache::lookup::unresolved;
+            cache.insert(addresses[i], nullptr);
+        }
+    }
+
+#endif
+}
+
+} // namespace detail
+
+inline std::vector<stack_frame> symbolize(void* const* addresses, size_t count)
+{
+    auto& cache = detail::symbol_cache::instance();
+
+    std::vector<stack_frame> stack_frames(count);
+    std::vector<detail::symbol_cache::lookup> lookups(count);
+    bool any_miss = false;
+
+#ifndef _WIN32
+    // On Windows, the frames of unloaded modules are cleared when DbgHelp's module list is refreshed.
+    cache.clear_if_modules_changed(detail::loaded_module_generation());
+#endif
+
+    // Repeated traces are resolved from the cache without taking the platform symbol lookup lock.
+    for (size_t i = 0; i < count; ++i)
+    {
+        lookups[i] = cache.find(addresses[i], stack_frames[i]);
+        any_miss |= lookups[i] == detail::symbol_cache::lookup::miss;
+    }
+
+    if (any_miss)
+        detail::resolve_cache_misses(addresses, count, lookups.data(), stack_frames.data());
+
+    size_t resolved_count = 0;
+
+    for (size_t i = 0; i < count; ++i)
+        if (lookups[i] == detail::symbol_cache::lookup::resolved)
+        {
+            if (resolved_count != i)
+                stack_frames[resolved_count] = std::move(stack_frames[i]);
+
+            resolved_count++;
+        }
+
+    stack_frames.resize(resolved_count);
+    return stack_frames;
+}
+
+inline symbol_cache_statistics symbol_cache_stats()
+{
+    return detail::symbol_cache::instance().statistics();
+}
+
+inline void clear_symbol_cache()
+{
+    detail::symbol_cache::instance().clear();
+}
+
+namespace detail
+{
+
+struct symbolize_request_node
+{
+    std::atomic<symbolize_request_node*> next{nullptr};
+};
+
+struct symbolize_request final : symbolize_request_node
+{
+    raw_stack_trace trace;
+    std::function<void(std::vector<stack_frame>)> callback;
+};
+
+// A single background thread that symbolizes the traces captured by `jg::stack_trace::capture_async()`.
+//
+// The requests are passed through an intrusive lock-free multiple producer, single consumer queue
+// (Dmitry Vyukov's algorithm). A producer only takes the wakeup lock if the symbolizer thread
+// has run out of requests and is about to sleep, or is sleeping.
+//
+// The thread is started on first use, and the process exit waits for it to finish the requests
+// that are already queued.
+class background_symbolizer final
+{
+public:
+    static background_symbolizer& instance()
+    {
+        static background_symbolizer symbolizer;
+        return symbolizer;
+    }
+
+    void enqueue(std::unique_ptr<symbolize_request> request)
+    {
+        push(request.release());
+
+        if (m_waiting.load())
+        {
+            std::lock_guard<std::mutex> lock{m_mutex};
+            m_waiting = false;
+            m_wakeup.notify_one();
+        }
+    }
+
+    background_symbolizer(const background_symbolizer&) = delete;
+    background_symbolizer& operator=(const background_symbolizer&) = delete;
+
+private:
+    background_symbolizer()
+        : m_head(&m_stub)
+        , m_tail(&m_stub)
+    {
+        construct_symbolization_singletons();
+        m_thread = std::thread([this] { run(); });
+    }
+
+    ~background_symbolizer()
+    {
+        {
+            std::lock_guard<std::mutex> lock{m_mutex};
+            m_stopping = true;
+        }
+
+        m_wakeup.notify_one();
+        m_thread.join();
+    }
+
+    void run()
+    {
+        for (;;)
+        {
+            if (auto* request = pop())
+            {
+                process(request);
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock{m_mutex};
+            m_waiting = true;
+
+            // A request pushed after the last pop, but before `m_waiting` was set, is found here.
+            if (auto* request = pop())
+            {
+                m_waiting = false;
+                lock.unlock();
+                process(request);
+                continue;
+            }
+
+            if (m_stopping)
+                return;
+
+            m_wakeup.wait(lock, [this] { return !m_waiting || m_stopping; });
+            m_waiting = false;
+        }
+    }
+
+    static void process(symbolize_request* raw_request)
+    {
+        std::unique_ptr<symbolize_request> request{raw_request};
+        request->callback(request->trace.resolve());
+    }
+
+    void push(symbolize_request_node* node)
+    {
+        node->next.store(nullptr, std::memory_order_relaxed);
+        auto* previous = m_head.exchange(node);
+        previous->next.store(node);
+    }
+
+    // Only called by the symbolizer thread.
+    symbolize_request* pop()
+    {
+        auto* tail = m_tail;
+        auto* next = tail->next.load();
+
+        if (tail == &m_stub)
+        {
+            if (!next)
+                return nullptr;
+
+            m_tail = next;
+            tail = next;
+            next = next->next.load();
+        }
+
+        if (next)
+        {
+            m_tail = next;
+            return static_cast<symbolize_request*>(tail);
+        }
+
+        if (tail != m_head.load())
+            return nullptr; // A producer is in the middle of a push, and will wake the thread up if needed.
+
+        push(&m_stub);
+        next = tail->next.load();
+
+        if (next)
+        {
+            m_tail = next;
+            return static_cast<symbolize_request*>(tail);
+        }
+
+        return nullptr;
+    }
+
+    symbolize_request_node m_stub;
+    std::atomic<symbolize_request_node*> m_head;
+    symbolize_request_node* m_tail;
+
+    std::mutex m_mutex;
+    std::condition_variable m_wakeup;
+    std::atomic<bool> m_waiting{false};
+    bool m_stopping = false;
+
+    std::thread m_thread;
+};
+
+} // namespace detail
+
+inline size_t stack_trace::raw_capacity() const
+{
+    return m_include_frame_count < raw_stack_trace::max_frame_count ? m_include_frame_count
+                                                                    : raw_stack_trace::max_frame_count;
+}
+
+JG_STACK_TRACE_NOINLINE inline std::future<std::vector<stack_frame>> stack_trace::capture_async() const
+{
+    auto request = std::make_unique<detail::symbolize_request>();
+    detail::capture_addresses(request->trace.m_addresses.data(), raw_capacity(), m_skip_frame_count + 1, request->trace.m_size);
+
+    auto promise = std::make_shared<std::promise<std::vector<stack_frame>>>();
+    auto future = promise->get_future();
+    request->callback = [promise](std::vector<stack_frame> frames) { promise->set_value(std::move(frames)); };
+
+    detail::background_symbolizer::instance().enqueue(std::move(request));
+    return future;
+}
+
+JG_STACK_TRACE_NOINLINE inline void stack_trace::capture_async(std::function<void(std::vector<stack_frame>)> callback) const
+{
+    auto request = std::make_unique<detail::symbolize_request>();
+    detail::capture_addresses(request->trace.m_addresses.data(), raw_capacity(), m_skip_frame_count + 1, request->trace.m_size);
+    request->callback = std::move(callback);
+
+    detail::background_symbolizer::instance().enqueue(std::move(request));
 }
 
 } // namespace jg
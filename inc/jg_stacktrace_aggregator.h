@@ -0,0 +1,233 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <unordered_map>
+#include <vector>
+#include "jg_stacktrace.h"
+#include "jg_stacktrace_compact.h"
+
+namespace jg
+{
+
+/// A unique stack trace and the number of times it was added to a `jg::stack_trace_aggregator`.
+struct aggregated_stack_trace final
+{
+    std::size_t count;
+    std::vector<void*> addresses;
+    std::vector<stack_frame> frames;
+};
+
+/// @class jg::stack_trace_aggregator
+///
+/// Deduplicates and counts raw stack traces, for instance from a `jg::verify` failing in a loop,
+/// or from traces captured at lock contention. Each unique trace is stored once, together with
+/// its occurrence count, and it's only symbolized once, when a report is requested. The symbolized
+/// traces are kept as `jg::compact_stack_traces`, which share the names of their functions.
+///
+/// Adding traces is thread safe. The traces are spread over shards with their own locks by the
+/// hash of their addresses, so several threads can add traces at the same time with low
+/// contention. Adding an already known trace doesn't allocate.
+///
+/// @example
+///
+///     jg::stack_trace_aggregator contention_traces;
+///
+///     // On any number of threads
+///     if (!mutex.try_lock())
+///     {
+///         contention_traces.add(jg::stack_trace().include_frame_count(16).capture_raw());
+///         mutex.lock();
+///     }
+///
+///     // When done
+///     contention_traces.report(std::cerr);
+class stack_trace_aggregator final
+{
+public:
+    void add(const raw_stack_trace& trace);
+    void add(void* const* addresses, size_t count);
+
+    /// Returns the unique traces, symbolized, ordered by descending occurrence count.
+    std::vector<aggregated_stack_trace> traces();
+
+    /// Writes the unique traces, ordered by descending occurrence count, to `stream`.
+    void report(std::ostream& stream);
+
+    size_t unique_count() const;
+    size_t total_count() const;
+
+    void clear();
+
+private:
+    static constexpr size_t shard_count = 16;
+
+    static constexpr size_t unsymbolized = static_cast<size_t>(-1);
+
+    struct entry final
+    {
+        std::vector<void*> addresses;
+        size_t count;
+        size_t trace; // The index of the symbolized trace in the shard's `traces`, or `unsymbolized`.
+    };
+
+    struct shard final
+    {
+        mutable std::mutex mutex;
+        std::unordered_map<std::uint64_t, std::vector<entry>> entries; // Keyed by trace hash.
+        compact_stack_traces traces;
+    };
+
+    static std::uint64_t hash(void* const* addresses, size_t count);
+
+    std::array<shard, shard_count> m_shards;
+};
+
+inline void stack_trace_aggregator::add(const raw_stack_trace& trace)
+{
+    add(trace.begin(), trace.size());
+}
+
+inline void stack_trace_aggregator::add(void* const* addresses, size_t count)
+{
+    const auto trace_hash = hash(addresses, count);
+    auto& shard = m_shards[trace_hash % shard_count];
+
+    std::lock_guard<std::mutex> lock{shard.mutex};
+    auto& entries = shard.entries[trace_hash];
+
+    for (auto& entry : entries)
+        if (std::equal(entry.addresses.begin(), entry.addresses.end(), addresses, addresses + count))
+        {
+            entry.count++;
+            return;
+        }
+
+    entries.push_back({std::vector<void*>(addresses, addresses + count), 1, unsymbolized});
+}
+
+inline std::vector<aggregated_stack_trace> stack_trace_aggregator::traces()
+{
+    std::vector<aggregated_stack_trace> traces;
+
+    for (auto& shard : m_shards)
+    {
+        std::vector<aggregated_stack_trace> shard_traces;
+        std::vector<size_t> unsymbolized_traces;
+
+        {
+            std::lock_guard<std::mutex> lock{shard.mutex};
+
+            for (const auto& hashed_entries : shard.entries)
+                for (const auto& entry : hashed_entries.second)
+                {
+                    if (entry.trace == unsymbolized)
+                        unsymbolized_traces.push_back(shard_traces.size());
+
+                    shard_traces.push_back({entry.count,
+                                            entry.addresses,
+                                            entry.trace == unsymbolized ? std::vector<stack_frame>{} : shard.traces.frames(entry.trace)});
+                }
+        }
+
+        // Symbolization is slow, so it's done without holding the shard lock, and only for the
+        // traces that haven't already been symbolized by an earlier report.
+        for (const auto index : unsymbolized_traces)
+        {
+            auto& trace = shard_traces[index];
+            trace.frames = symbolize(trace.addresses.data(), trace.addresses.size());
+
+            std::lock_guard<std::mutex> lock{shard.mutex};
+            const auto found = shard.entries.find(hash(trace.addresses.data(), trace.addresses.size()));
+
+            if (found != shard.entries.end())
+                for (auto& entry : found->second)
+                    if (entry.addresses == trace.addresses && entry.trace == unsymbolized)
+                        entry.trace = shard.traces.add(trace.frames);
+        }
+
+        traces.insert(traces.end(),
+                      std::make_move_iterator(shard_traces.begin()),
+                      std::make_move_iterator(shard_traces.end()));
+    }
+
+    std::stable_sort(traces.begin(), traces.end(), [](const auto& a, const auto& b) { return a.count > b.count; });
+    return traces;
+}
+
+inline void stack_trace_aggregator::report(std::ostream& stream)
+{
+    for (const auto& trace : traces())
+    {
+        stream << trace.count << (trace.count == 1 ? " occurrence:\n" : " occurrences:\n");
+
+        for (const auto& frame : trace.frames)
+            stream << frame << "\n";
+
+        stream << "\n";
+    }
+}
+
+inline size_t stack_trace_aggregator::unique_count() const
+{
+    size_t count = 0;
+
+    for (auto& shard : m_shards)
+    {
+        std::lock_guard<std::mutex> lock{shard.mutex};
+
+        for (const auto& hashed_entries : shard.entries)
+            count += hashed_entries.second.size();
+    }
+
+    return count;
+}
+
+inline size_t stack_trace_aggregator::total_count() const
+{
+    size_t count = 0;
+
+    for (auto& shard : m_shards)
+    {
+        std::lock_guard<std::mutex> lock{shard.mutex};
+
+        for (const auto& hashed_entries : shard.entries)
+            for (const auto& entry : hashed_entries.second)
+                count += entry.count;
+    }
+
+    return count;
+}
+
+inline void stack_trace_aggregator::clear()
+{
+    for (auto& shard : m_shards)
+    {
+        std::lock_guard<std::mutex> lock{shard.mutex};
+        shard.entries.clear();
+        shard.traces.clear();
+    }
+}
+
+inline std::uint64_t stack_trace_aggregator::hash(void* const* addresses, size_t count)
+{
+    // FNV-1a over the addresses, with a final mix since the shard is picked from the low bits.
+    std::uint64_t hash = 0xcbf29ce484222325ull;
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        hash ^= static_cast<std::uint64_t>(reinterpret_cast<std::uintptr_t>(addresses[i]));
+        hash *= 0x100000001b3ull;
+    }
+
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdull;
+    hash ^= hash >> 33;
+
+    return hash;
+}
+
+} // namespace jg
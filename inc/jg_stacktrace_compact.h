@@ -0,0 +1,276 @@
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "jg_stacktrace.h"
+
+namespace jg
+{
+
+/// A resolved stack frame in 16 bytes, for keeping many symbolized traces in memory. The package,
+/// function and file names, and the function address, are interned in a `jg::stack_symbol_table`, so
+/// each of them is only stored once however many frames refer to it.
+struct compact_stack_frame final
+{
+    std::uint32_t symbol;               // The id of the function in the symbol table.
+    std::uint32_t address_displacement; // Like `jg::stack_frame::address_displacement`.
+    std::uint32_t line;
+    std::uint32_t line_displacement;
+};
+
+static_assert(sizeof(compact_stack_frame) == 16, "compact_stack_frame is 16 bytes");
+
+/// The contiguous frames of a trace in a `jg::compact_stack_traces`, from the innermost frame.
+class compact_stack_trace final
+{
+public:
+    compact_stack_trace(const compact_stack_frame* begin, const compact_stack_frame* end)
+        : m_begin(begin)
+        , m_end(end)
+    {}
+
+    const compact_stack_frame* begin() const { return m_begin; }
+    const compact_stack_frame* end() const { return m_end; }
+    size_t size() const { return static_cast<size_t>(m_end - m_begin); }
+    bool empty() const { return m_begin == m_end; }
+    const compact_stack_frame& operator[](size_t index) const { return m_begin[index]; }
+
+private:
+    const compact_stack_frame* m_begin;
+    const compact_stack_frame* m_end;
+};
+
+struct stack_symbol_table_statistics final
+{
+    std::size_t strings;
+    std::size_t string_bytes; // Including the terminating null characters.
+    std::size_t symbols;
+};
+
+/// @class jg::stack_symbol_table
+///
+/// Interns the names and addresses of the functions in resolved stack frames, so that frames can be
+/// stored as `jg::compact_stack_frame`s and converted back into `jg::stack_frame`s. Each unique string
+/// is stored once, and each unique function (address, package, function name and file) has an id.
+/// Ids are never reused, so a compact frame stays valid as long as the table does.
+///
+/// Interning and converting are thread safe. `instance()` is the process-wide table that
+/// `jg::compact_stack_traces` uses by default.
+class stack_symbol_table final
+{
+public:
+    static stack_symbol_table& instance()
+    {
+        static stack_symbol_table table;
+        return table;
+    }
+
+    stack_symbol_table() { intern_string(std::string{}); }
+
+    stack_symbol_table(const stack_symbol_table&) = delete;
+    stack_symbol_table& operator=(const stack_symbol_table&) = delete;
+
+    compact_stack_frame intern(const stack_frame& frame);
+
+    /// Appends the `count` frames at `frames`, interned, to `output`.
+    void intern(const stack_frame* frames, size_t count, std::vector<compact_stack_frame>& output);
+
+    /// Appends the frames interned as `frames` to `output`.
+    void resolve(const compact_stack_frame* frames, size_t count, std::vector<stack_frame>& output) const;
+
+    stack_frame resolve(const compact_stack_frame& frame) const;
+
+    stack_symbol_table_statistics stats() const;
+
+private:
+    struct symbol final
+    {
+        std::uint64_t address;
+        std::uint32_t package;
+        std::uint32_t function;
+        std::uint32_t file;
+
+        bool operator==(const symbol& other) const
+        {
+            return address == other.address && package == other.package && function == other.function && file == other.file;
+        }
+    };
+
+    struct symbol_hash final
+    {
+        size_t operator()(const symbol& symbol) const
+        {
+            auto hash = static_cast<std::uint64_t>(symbol.address) * 0x9e3779b97f4a7c15ull;
+            hash ^= (static_cast<std::uint64_t>(symbol.package) << 42) ^ (static_cast<std::uint64_t>(symbol.function) << 21) ^ symbol.file;
+            return static_cast<size_t>(hash ^ (hash >> 29));
+        }
+    };
+
+    compact_stack_frame intern_locked(const stack_frame& frame);
+    std::uint32_t intern_string(const std::string& string);
+    void resolve(const compact_stack_frame& frame, stack_frame& output) const;
+
+    mutable std::mutex m_mutex;
+    std::unordered_map<std::string, std::uint32_t> m_string_ids;
+    std::vector<const std::string*> m_strings; // The keys of `m_string_ids`, which never move.
+    size_t m_string_bytes = 0;
+    std::unordered_map<symbol, std::uint32_t, symbol_hash> m_symbol_ids;
+    std::vector<symbol> m_symbols;
+};
+
+/// @class jg::compact_stack_traces
+///
+/// Stores resolved stack traces as contiguous `jg::compact_stack_frame`s, for instance the unique traces
+/// of a `jg::stack_trace_aggregator`, in a small fraction of the memory that `std::vector<stack_frame>`s
+/// take. The traces are appended, and they're indexed in the order that they're added.
+///
+/// Adding is not thread safe, like for the standard containers, but several instances can share a
+/// symbol table.
+///
+/// @example
+///
+///     jg::compact_stack_traces traces;
+///     const auto index = traces.add(jg::stack_trace().include_frame_count(32).capture());
+///     ...
+///     for (const auto& frame : traces.frames(index))
+///         std::cout << frame << "\n";
+class compact_stack_traces final
+{
+public:
+    explicit compact_stack_traces(stack_symbol_table& table = stack_symbol_table::instance())
+        : m_table(&table)
+    {}
+
+    /// Adds the trace of `count` frames at `frames`, and returns its index.
+    size_t add(const stack_frame* frames, size_t count);
+    size_t add(const std::vector<stack_frame>& frames) { return add(frames.data(), frames.size()); }
+
+    size_t size() const { return m_offsets.size() - 1; }
+    bool empty() const { return size() == 0; }
+
+    /// The number of frames of all traces.
+    size_t frame_count() const { return m_frames.size(); }
+
+    compact_stack_trace operator[](size_t index) const
+    {
+        return {m_frames.data() + m_offsets[index], m_frames.data() + m_offsets[index + 1]};
+    }
+
+    /// The trace at `index` as `jg::stack_frame`s, like `jg::symbolize()` returned them.
+    std::vector<stack_frame> frames(size_t index) const;
+
+    const stack_symbol_table& table() const { return *m_table; }
+
+    void clear();
+
+private:
+    stack_symbol_table* m_table;
+    std::vector<compact_stack_frame> m_frames;
+    std::vector<size_t> m_offsets{0}; // Where each trace begins in `m_frames`, and where the last one ends.
+};
+
+inline compact_stack_frame stack_symbol_table::intern(const stack_frame& frame)
+{
+    std::lock_guard<std::mutex> lock{m_mutex};
+    return intern_locked(frame);
+}
+
+inline void stack_symbol_table::intern(const stack_frame* frames, size_t count, std::vector<compact_stack_frame>& output)
+{
+    std::lock_guard<std::mutex> lock{m_mutex};
+
+    for (size_t i = 0; i < count; ++i)
+        output.push_back(intern_locked(frames[i]));
+}
+
+inline compact_stack_frame stack_symbol_table::intern_locked(const stack_frame& frame)
+{
+    const symbol key{frame.address, intern_string(frame.package), intern_string(frame.function), intern_string(frame.file)};
+    const auto found = m_symbol_ids.emplace(key, static_cast<std::uint32_t>(m_symbols.size()));
+
+    if (found.second)
+        m_symbols.push_back(key);
+
+    return {found.first->second,
+            static_cast<std::uint32_t>(frame.address_displacement),
+            static_cast<std::uint32_t>(frame.line),
+            static_cast<std::uint32_t>(frame.line_displacement)};
+}
+
+inline void stack_symbol_table::resolve(const compact_stack_frame* frames, size_t count, std::vector<stack_frame>& output) const
+{
+    const auto first = output.size();
+    output.resize(first + count);
+
+    std::lock_guard<std::mutex> lock{m_mutex};
+
+    for (size_t i = 0; i < count; ++i)
+        resolve(frames[i], output[first + i]);
+}
+
+inline stack_frame stack_symbol_table::resolve(const compact_stack_frame& frame) const
+{
+    stack_frame output{};
+
+    std::lock_guard<std::mutex> lock{m_mutex};
+    resolve(frame, output);
+    return output;
+}
+
+inline stack_symbol_table_statistics stack_symbol_table::stats() const
+{
+    std::lock_guard<std::mutex> lock{m_mutex};
+    return {m_strings.size(), m_string_bytes, m_symbols.size()};
+}
+
+inline std::uint32_t stack_symbol_table::intern_string(const std::string& string)
+{
+    const auto found = m_string_ids.emplace(string, static_cast<std::uint32_t>(m_strings.size()));
+
+    if (found.second)
+    {
+        m_strings.push_back(&found.first->first);
+        m_string_bytes += string.size() + 1;
+    }
+
+    return found.first->second;
+}
+
+inline void stack_symbol_table::resolve(const compact_stack_frame& frame, stack_frame& output) const
+{
+    const auto& symbol = m_symbols[frame.symbol];
+
+    output.address              = symbol.address;
+    output.address_displacement = frame.address_displacement;
+    output.package              = *m_strings[symbol.package];
+    output.function             = *m_strings[symbol.function];
+    output.file                 = *m_strings[symbol.file];
+    output.line                 = frame.line;
+    output.line_displacement    = frame.line_displacement;
+}
+
+inline size_t compact_stack_traces::add(const stack_frame* frames, size_t count)
+{
+    m_table->intern(frames, count, m_frames);
+    m_offsets.push_back(m_frames.size());
+    return m_offsets.size() - 2;
+}
+
+inline std::vector<stack_frame> compact_stack_traces::frames(size_t index) const
+{
+    const auto trace = (*this)[index];
+    std::vector<stack_frame> frames;
+    m_table->resolve(trace.begin(), trace.size(), frames);
+    return frames;
+}
+
+inline void compact_stack_traces::clear()
+{
+    m_frames.clear();
+    m_offsets.resize(1);
+}
+
+} // namespace jg
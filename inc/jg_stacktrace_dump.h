@@ -0,0 +1,655 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <istream>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "jg_stacktrace.h"
+
+//
+// The jg stack trace dump format is a stream of records, where all integers are ULEB128 encoded:
+//
+//   header: 'J' 'G' 'S' 'T' <version>
+//   module: 'M' <id> <base> <size> <build id length> <build id bytes> <path length> <path bytes>
+//   trace:  'T' <frame count> (<module id> <offset>)...
+//
+// A module record is written once, before the first trace that has a frame in the module. The
+// offset of a frame is relative to the module base (the image base on Windows and the load bias
+// on ELF platforms), which makes a trace symbolizable offline against the matching binaries. A
+// frame that isn't in any known module has module id 0 and its absolute address as offset.
+//
+// The build id is the PDB GUID and age on Windows, and the GNU build id on ELF platforms.
+//
+// A trace has at most 65536 frames, and the build id and the path at most 65536 bytes, so that a
+// corrupt dump is rejected by the reader rather than making it allocate without bounds.
+//
+
+namespace jg
+{
+
+struct dump_module final
+{
+    std::uint64_t id;
+    std::uint64_t base;
+    std::uint64_t size;
+    std::string build_id;
+    std::string path;
+};
+
+struct dump_frame final
+{
+    std::uint64_t module_id;
+    std::uint64_t offset;
+};
+
+namespace detail
+{
+
+constexpr char dump_magic[] = {'J', 'G', 'S', 'T'};
+constexpr std::uint8_t dump_version = 1;
+constexpr size_t dump_max_frame_count = 0x10000;
+
+inline void write_uleb128(std::ostream& stream, std::uint64_t value)
+{
+    char bytes[10];
+    size_t count = 0;
+
+    do
+    {
+        bytes[count] = static_cast<char>(value & 0x7f);
+        value >>= 7;
+
+        if (value)
+            bytes[count] |= static_cast<char>(0x80);
+
+        count++;
+    }
+    while (value);
+
+    stream.write(bytes, count);
+}
+
+inline bool read_uleb128(std::istream& stream, std::uint64_t& value)
+{
+    value = 0;
+
+    for (unsigned shift = 0; shift < 64; shift += 7)
+    {
+        const auto byte = stream.get();
+
+        if (byte == std::char_traits<char>::eof())
+            return false;
+
+        value |= static_cast<std::uint64_t>(byte & 0x7f) << shift;
+
+        if (!(byte & 0x80))
+            return true;
+    }
+
+    return false;
+}
+
+// A loaded module with the address range that it occupies in this process.
+struct dump_module_range final
+{
+    std::uintptr_t begin;
+    std::uintptr_t end;
+    dump_module module;
+};
+
+#if defined(_WIN32)
+
+inline bool find_dump_module(const void* address, dump_module_range& range)
+{
+    HMODULE handle = nullptr;
+
+    if (!GetModuleHandleExW(GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS | GET_MODULE_HANDLE_EX_FLAG_UNCHANGED_REFCOUNT,
+                            static_cast<LPCWSTR>(address),
+                            &handle))
+        return false;
+
+    const auto* image = reinterpret_cast<const std::uint8_t*>(handle);
+    const auto* dos_header = reinterpret_cast<const IMAGE_DOS_HEADER*>(image);
+    const auto* nt_headers = reinterpret_cast<const IMAGE_NT_HEADERS*>(image + dos_header->e_lfanew);
+
+    range.module.base = reinterpret_cast<std::uintptr_t>(image);
+    range.module.size = nt_headers->OptionalHeader.SizeOfImage;
+    range.begin       = static_cast<std::uintptr_t>(range.module.base);
+    range.end         = static_cast<std::uintptr_t>(range.module.base + range.module.size);
+
+    // The PDB GUID and age are in the CodeView entry of the debug directory.
+    const auto& debug_directory = nt_headers->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_DEBUG];
+
+    if (debug_directory.VirtualAddress)
+    {
+        const auto* entries = reinterpret_cast<const IMAGE_DEBUG_DIRECTORY*>(image + debug_directory.VirtualAddress);
+
+        for (size_t i = 0; i < debug_directory.Size / sizeof(IMAGE_DEBUG_DIRECTORY); ++i)
+        {
+            const auto& entry = entries[i];
+            const auto* codeview = image + entry.AddressOfRawData;
+
+            if (entry.Type == IMAGE_DEBUG_TYPE_CODEVIEW && entry.AddressOfRawData && entry.SizeOfData >= 24 &&
+                std::memcmp(codeview, "RSDS", 4) == 0)
+                range.module.build_id.assign(reinterpret_cast<const char*>(codeview + 4), 20);
+        }
+    }
+
+    wchar_t path[MAX_PATH];
+    const auto path_length = static_cast<int>(GetModuleFileNameW(handle, path, MAX_PATH));
+    const auto size = WideCharToMultiByte(CP_UTF8, 0, path, path_length, nullptr, 0, nullptr, nullptr);
+
+    if (size > 0)
+    {
+        range.module.path.resize(size);
+        WideCharToMultiByte(CP_UTF8, 0, path, path_length, &range.module.path[0], size, nullptr, nullptr);
+    }
+
+    return true;
+}
+
+#elif defined(__ELF__)
+
+struct dump_module_search final
+{
+    std::uintptr_t address;
+    dump_module_range& range;
+};
+
+inline int find_dump_module_callback(dl_phdr_info* info, size_t, void* data)
+{
+    const auto address = static_cast<dump_module_search*>(data)->address;
+    auto& range = static_cast<dump_module_search*>(data)->range;
+    std::uintptr_t begin = UINTPTR_MAX;
+    std::uintptr_t end = 0;
+
+    for (size_t i = 0; i < info->dlpi_phnum; ++i)
+    {
+        const auto& segment = info->dlpi_phdr[i];
+
+        if (segment.p_type == PT_LOAD)
+        {
+            begin = std::min<std::uintptr_t>(begin, info->dlpi_addr + segment.p_vaddr);
+            end   = std::max<std::uintptr_t>(end, info->dlpi_addr + segment.p_vaddr + segment.p_memsz);
+        }
+    }
+
+    if (address < begin || address >= end)
+        return 0;
+
+    range.begin       = begin;
+    range.end         = end;
+    range.module.base = info->dlpi_addr;
+    range.module.size = end - info->dlpi_addr;
+
+    for (size_t i = 0; i < info->dlpi_phnum && range.module.build_id.empty(); ++i)
+    {
+        const auto& segment = info->dlpi_phdr[i];
+
+        if (segment.p_type == PT_NOTE)
+            range.module.build_id = find_gnu_build_id(reinterpret_cast<const std::uint8_t*>(info->dlpi_addr + segment.p_vaddr),
+                                                      segment.p_memsz);
+    }
+
+    if (info->dlpi_name && *info->dlpi_name)
+        range.module.path = info->dlpi_name;
+    else
+    {
+        char path[4096];
+        const auto length = ::readlink("/proc/self/exe", path, sizeof(path));
+        range.module.path.assign(path, length > 0 ? length : 0);
+    }
+
+    return 1;
+}
+
+inline bool find_dump_module(const void* address, dump_module_range& range)
+{
+    dump_module_search search{reinterpret_cast<std::uintptr_t>(address), range};
+    return dl_iterate_phdr(find_dump_module_callback, &search) != 0;
+}
+
+#else
+
+inline bool find_dump_module(const void* address, dump_module_range& range)
+{
+    Dl_info dl_info{};
+
+    if (!dladdr(address, &dl_info) || !dl_info.dli_fbase)
+        return false;
+
+    // The module size isn't known, so the range only covers the address itself.
+    range.module.base = reinterpret_cast<std::uintptr_t>(dl_info.dli_fbase);
+    range.module.size = 0;
+    range.module.path = dl_info.dli_fname ? dl_info.dli_fname : "";
+    range.begin       = reinterpret_cast<std::uintptr_t>(address);
+    range.end         = range.begin + 1;
+
+    return true;
+}
+
+#endif
+
+} // namespace detail
+
+/// @class jg::stack_trace_dump_writer
+///
+/// Streams raw stack traces in the compact jg stack trace dump format, described at the top of this
+/// file, to a file or a memory buffer. No symbolization is done in the process. That's done offline,
+/// for instance by the `jg_stacktrace_symbolize` sample tool, using `jg::stack_trace_dump_reader`
+/// and `jg::stack_trace_dump_symbolizer`.
+///
+/// Writing traces is thread safe.
+///
+/// @example
+///
+///     std::ofstream file("traces.jgst", std::ios::binary);
+///     jg::stack_trace_dump_writer writer(file);
+///     ...
+///     if (suspicious_event)
+///         writer.write(jg::stack_trace().include_frame_count(32).capture_raw());
+class stack_trace_dump_writer final
+{
+public:
+    explicit stack_trace_dump_writer(std::ostream& stream);
+
+    void write(const raw_stack_trace& trace);
+    void write(void* const* addresses, size_t count);
+
+    stack_trace_dump_writer(const stack_trace_dump_writer&) = delete;
+    stack_trace_dump_writer& operator=(const stack_trace_dump_writer&) = delete;
+
+private:
+    const detail::dump_module_range* find_module(const void* address);
+
+    std::mutex m_mutex;
+    std::ostream& m_stream;
+    std::vector<detail::dump_module_range> m_modules; // Sorted by address range.
+};
+
+inline stack_trace_dump_writer::stack_trace_dump_writer(std::ostream& stream)
+    : m_stream(stream)
+{
+    m_stream.write(detail::dump_magic, sizeof(detail::dump_magic));
+    detail::write_uleb128(m_stream, detail::dump_version);
+}
+
+inline void stack_trace_dump_writer::write(const raw_stack_trace& trace)
+{
+    write(trace.begin(), trace.size());
+}
+
+inline void stack_trace_dump_writer::write(void* const* addresses, size_t count)
+{
+    if (count > detail::dump_max_frame_count)
+        count = detail::dump_max_frame_count; // The innermost frames.
+
+    std::vector<dump_frame> frames(count);
+    std::lock_guard<std::mutex> lock{m_mutex};
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        const auto address = reinterpret_cast<std::uintptr_t>(addresses[i]);
+
+        if (const auto* range = find_module(addresses[i]))
+            frames[i] = {range->module.id, address - range->module.base};
+        else
+            frames[i] = {0, address};
+    }
+
+    m_stream.put('T');
+    detail::write_uleb128(m_stream, count);
+
+    for (const auto& frame : frames)
+    {
+        detail::write_uleb128(m_stream, frame.module_id);
+        detail::write_uleb128(m_stream, frame.offset);
+    }
+}
+
+inline const detail::dump_module_range* stack_trace_dump_writer::find_module(const void* address)
+{
+    const auto value = reinterpret_cast<std::uintptr_t>(address);
+    auto found = std::upper_bound(m_modules.begin(), m_modules.end(), value,
+                                  [](std::uintptr_t a, const detail::dump_module_range& r) { return a < r.begin; });
+
+    if (found != m_modules.begin() && value < std::prev(found)->end)
+        return &*std::prev(found);
+
+    detail::dump_module_range range{};
+
+    if (!detail::find_dump_module(address, range))
+        return nullptr;
+
+    // The module table is written once per module, before the first trace that refers to it.
+    range.module.id = m_modules.size() + 1;
+
+    m_stream.put('M');
+    detail::write_uleb128(m_stream, range.module.id);
+    detail::write_uleb128(m_stream, range.module.base);
+    detail::write_uleb128(m_stream, range.module.size);
+    detail::write_uleb128(m_stream, range.module.build_id.size());
+    m_stream.write(range.module.build_id.data(), range.module.build_id.size());
+    detail::write_uleb128(m_stream, range.module.path.size());
+    m_stream.write(range.module.path.data(), range.module.path.size());
+
+    found = std::upper_bound(m_modules.begin(), m_modules.end(), range.begin,
+                             [](std::uintptr_t a, const detail::dump_module_range& r) { return a < r.begin; });
+
+    return &*m_modules.insert(found, std::move(range));
+}
+
+/// @class jg::stack_trace_dump_reader
+///
+/// Reads traces written by `jg::stack_trace_dump_writer`, one at a time.
+///
+/// @example
+///
+///     std::ifstream file("traces.jgst", std::ios::binary);
+///     jg::stack_trace_dump_reader reader(file);
+///     std::vector<jg::dump_frame> trace;
+///
+///     while (reader.next(trace))
+///         ...
+///
+///     if (reader.failed())
+///         ...
+class stack_trace_dump_reader final
+{
+public:
+    explicit stack_trace_dump_reader(std::istream& stream);
+
+    /// Reads the next trace into `trace`. Returns `false` at the end of the dump, or if the dump is
+    /// malformed, in which case `failed()` returns `true`.
+    bool next(std::vector<dump_frame>& trace);
+
+    bool failed() const { return m_failed; }
+
+    /// The modules that have been read so far. All modules referred to by a trace returned by
+    /// `next()` are included.
+    const std::vector<dump_module>& modules() const { return m_modules; }
+
+private:
+    bool read_module();
+    bool read_bytes(std::string& bytes);
+
+    std::istream& m_stream;
+    std::vector<dump_module> m_modules;
+    bool m_failed = false;
+};
+
+inline stack_trace_dump_reader::stack_trace_dump_reader(std::istream& stream)
+    : m_stream(stream)
+{
+    char magic[sizeof(detail::dump_magic)] = {};
+    std::uint64_t version = 0;
+
+    m_stream.read(magic, sizeof(magic));
+
+    m_failed = !m_stream ||
+               !std::equal(magic, magic + sizeof(magic), detail::dump_magic) ||
+               !detail::read_uleb128(m_stream, version) ||
+               version != detail::dump_version;
+}
+
+inline bool stack_trace_dump_reader::next(std::vector<dump_frame>& trace)
+{
+    while (!m_failed)
+    {
+        const auto type = m_stream.get();
+
+        if (type == std::char_traits<char>::eof())
+            return false;
+
+        if (type == 'M')
+        {
+            m_failed = !read_module();
+            continue;
+        }
+
+        std::uint64_t count = 0;
+
+        if (type != 'T' || !detail::read_uleb128(m_stream, count) || count > detail::dump_max_frame_count)
+            break;
+
+        trace.resize(static_cast<size_t>(count));
+
+        for (auto& frame : trace)
+            if (!detail::read_uleb128(m_stream, frame.module_id) || !detail::read_uleb128(m_stream, frame.offset))
+            {
+                m_failed = true;
+                return false;
+            }
+
+        return true;
+    }
+
+    m_failed = true;
+    return false;
+}
+
+inline bool stack_trace_dump_reader::read_module()
+{
+    dump_module module{};
+
+    if (!detail::read_uleb128(m_stream, module.id) ||
+        !detail::read_uleb128(m_stream, module.base) ||
+        !detail::read_uleb128(m_stream, module.size) ||
+        !read_bytes(module.build_id) ||
+        !read_bytes(module.path))
+        return false;
+
+    m_modules.push_back(std::move(module));
+    return true;
+}
+
+inline bool stack_trace_dump_reader::read_bytes(std::string& bytes)
+{
+    std::uint64_t size = 0;
+
+    if (!detail::read_uleb128(m_stream, size) || size > 0x10000)
+        return false;
+
+    bytes.resize(static_cast<size_t>(size));
+    m_stream.read(&bytes[0], bytes.size());
+
+    return static_cast<bool>(m_stream);
+}
+
+/// @class jg::stack_trace_dump_symbolizer
+///
+/// Symbolizes traces read by `jg::stack_trace_dump_reader` against the binaries of the modules that
+/// the traces were captured in. A binary is looked for at the path recorded in the dump, and then
+/// by file name in the given search directories. A binary with another build id than the recorded
+/// one is rejected, since its symbols would be wrong.
+///
+/// Symbolization is supported on Windows (DbgHelp) and ELF platforms.
+class stack_trace_dump_symbolizer final
+{
+public:
+    explicit stack_trace_dump_symbolizer(std::vector<std::string> search_directories = {});
+    ~stack_trace_dump_symbolizer();
+
+    std::vector<stack_frame> symbolize(const std::vector<dump_frame>& trace, const std::vector<dump_module>& modules);
+
+    /// Problems found with the modules, like missing binaries or build id mismatches.
+    const std::vector<std::string>& warnings() const { return m_warnings; }
+
+    stack_trace_dump_symbolizer(const stack_trace_dump_symbolizer&) = delete;
+    stack_trace_dump_symbolizer& operator=(const stack_trace_dump_symbolizer&) = delete;
+
+private:
+    struct loaded_binary final
+    {
+        std::uint64_t module_id = 0;
+        bool loaded = false;
+#ifdef __ELF__
+        std::unique_ptr<detail::elf_module_info> info;
+#endif
+    };
+
+    loaded_binary& binary_for(const dump_module& module);
+    std::vector<std::string> candidate_paths(const std::string& path) const;
+
+    std::vector<std::string> m_search_directories;
+    std::vector<loaded_binary> m_binaries;
+    std::vector<std::string> m_warnings;
+#ifdef _WIN32
+    HANDLE m_process;
+    bool m_initialized = false;
+#endif
+};
+
+inline stack_trace_dump_symbolizer::stack_trace_dump_symbolizer(std::vector<std::string> search_directories)
+    : m_search_directories(std::move(search_directories))
+#ifdef _WIN32
+    , m_process(reinterpret_cast<HANDLE>(this)) // Any unique value identifies an offline DbgHelp session.
+#endif
+{
+#ifdef _WIN32
+    std::string search_path;
+
+    for (const auto& directory : m_search_directories)
+        search_path += (search_path.empty() ? "" : ";") + directory;
+
+    std::lock_guard<std::mutex> dbghlp_lock{detail::dbghlp_session::instance().mutex()};
+    m_initialized = SymInitialize(m_process, search_path.empty() ? NULL : search_path.c_str(), FALSE) != FALSE;
+#endif
+}
+
+inline stack_trace_dump_symbolizer::~stack_trace_dump_symbolizer()
+{
+#ifdef _WIN32
+    std::lock_guard<std::mutex> dbghlp_lock{detail::dbghlp_session::instance().mutex()};
+
+    if (m_initialized)
+        SymCleanup(m_process);
+#endif
+}
+
+inline std::vector<stack_frame> stack_trace_dump_symbolizer::symbolize(const std::vector<dump_frame>& trace,
+                                                                       const std::vector<dump_module>& modules)
+{
+    std::vector<stack_frame> frames;
+
+    for (const auto& dump_frame : trace)
+    {
+        const auto module = std::find_if(modules.begin(), modules.end(),
+                                         [&](const dump_module& m) { return m.id == dump_frame.module_id; });
+
+        stack_frame frame{};
+        bool resolved = false;
+
+        if (module != modules.end() && binary_for(*module).loaded)
+        {
+#if defined(_WIN32)
+            std::lock_guard<std::mutex> dbghlp_lock{detail::dbghlp_session::instance().mutex()};
+            resolved = detail::resolve_frame(m_process, module->base + dump_frame.offset, frame);
+#elif defined(__ELF__)
+            resolved = binary_for(*module).info->resolve(static_cast<std::uintptr_t>(module->base + dump_frame.offset),
+                                                         static_cast<std::uintptr_t>(module->base),
+                                                         frame);
+#endif
+        }
+
+        // Unresolved frames are kept, unlike with in-process symbolization, so that the offsets can
+        // be looked up by other means.
+        if (!resolved)
+        {
+            frame = stack_frame{};
+            frame.address  = module != modules.end() ? module->base + dump_frame.offset : dump_frame.offset;
+            frame.function = module != modules.end() ? module->path : "?";
+        }
+
+        frames.push_back(std::move(frame));
+    }
+
+    return frames;
+}
+
+inline stack_trace_dump_symbolizer::loaded_binary& stack_trace_dump_symbolizer::binary_for(const dump_module& module)
+{
+    for (auto& binary : m_binaries)
+        if (binary.module_id == module.id)
+            return binary;
+
+    m_binaries.emplace_back();
+    auto& binary = m_binaries.back();
+    binary.module_id = module.id;
+
+    for (const auto& path : candidate_paths(module.path))
+    {
+#if defined(_WIN32)
+        std::lock_guard<std::mutex> dbghlp_lock{detail::dbghlp_session::instance().mutex()};
+
+        if (!m_initialized)
+            break;
+
+        const DWORD64 base = SymLoadModuleEx(m_process, NULL, path.c_str(), NULL, module.base, static_cast<DWORD>(module.size), NULL, 0);
+
+        if (!base)
+            continue;
+
+        IMAGEHLP_MODULE64 info{};
+        info.SizeOfStruct = sizeof(info);
+
+        std::string build_id;
+
+        if (SymGetModuleInfo64(m_process, base, &info))
+        {
+            build_id.assign(reinterpret_cast<const char*>(&info.PdbSig70), sizeof(info.PdbSig70));
+            build_id.append(reinterpret_cast<const char*>(&info.PdbAge), sizeof(info.PdbAge));
+        }
+
+        if (!module.build_id.empty() && build_id != module.build_id)
+        {
+            SymUnloadModule64(m_process, base);
+            m_warnings.push_back(path + ": PDB signature mismatch");
+            continue;
+        }
+
+        binary.loaded = true;
+        break;
+#elif defined(__ELF__)
+        auto info = std::make_unique<detail::elf_module_info>(path);
+
+        if (!module.build_id.empty() && info->build_id() != module.build_id)
+        {
+            if (!info->build_id().empty())
+                m_warnings.push_back(path + ": build id mismatch");
+
+            continue;
+        }
+
+        binary.info = std::move(info);
+        binary.loaded = true;
+        break;
+#else
+        (void)path;
+#endif
+    }
+
+    if (!binary.loaded)
+        m_warnings.push_back(module.path + ": no matching binary found");
+
+    return binary;
+}
+
+inline std::vector<std::string> stack_trace_dump_symbolizer::candidate_paths(const std::string& path) const
+{
+    std::vector<std::string> paths{path};
+    const auto separator = path.find_last_of("/\\");
+    const auto file_name = separator == std::string::npos ? path : path.substr(separator + 1);
+
+    for (const auto& directory : m_search_directories)
+        paths.push_back(directory + "/" + file_name);
+
+    return paths;
+}
+
+} // namespace jg
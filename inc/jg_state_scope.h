@@ -1,5 +1,13 @@
 #pragma once
 
+#include <utility>
+
+#if defined(__GNUC__) || defined(__clang__)
+#define JG_STATE_SCOPE_LIKELY(condition) __builtin_expect(!!(condition), 1)
+#else
+#define JG_STATE_SCOPE_LIKELY(condition) (!!(condition))
+#endif
+
 namespace jg
 {
 
@@ -18,7 +26,9 @@ namespace jg
 ///
 /// @note Depending on *any* global/static state in a test is inherently not thread safe. This
 /// means that no tests that depend on global/static state should should run concurrently. That
-/// is a deficiency of the tested code, not of the `jg::state_scope_value` helper class.
+/// is a deficiency of the tested code, not of the `jg::state_scope_value` helper class. Global
+/// state that's declared as a `jg::overridable` can be changed per thread with a
+/// `jg::state_scope_override` instead, so that such tests can run concurrently.
 ///
 /// @example
 ///
@@ -116,4 +126,153 @@ private:
     V m_exit_action;
 };
 
+namespace detail
+{
+
+// An override of a `jg::overridable`, in the list of the overrides that are in effect on a thread,
+// newest first.
+struct state_override final
+{
+    const void* instance;
+    const void* value;
+    state_override* next;
+};
+
+inline state_override*& thread_state_overrides()
+{
+    static thread_local state_override* overrides = nullptr;
+    return overrides;
+}
+
+} // namespace detail
+
+/// @class jg::overridable
+///
+/// A global/static value that a test can override for the calling thread only, with a
+/// `jg::state_scope_override`, so that tests that change global state can run concurrently on
+/// different threads, for instance when a test runner shards them over all cores.
+///
+/// A read first checks the overrides of the calling thread. When no override is in effect on the
+/// thread, which is the case outside of such tests, that's a single predictable branch. Otherwise
+/// the thread's overrides, which are typically few, are searched for the overridable.
+///
+/// @note An override is only seen by the thread that made it, so code under test that reads the
+/// value on threads of its own sees the global value. The global value itself is as thread unsafe
+/// as any global/static state.
+///
+/// @example
+///
+///     jg::overridable<bool> g_some_global_flag{true};
+///
+///     bool perform_action()
+///     {
+///         return g_some_global_flag.get() ? do_this() : do_that();
+///     }
+///
+///     TEST() // Can run concurrently with other tests that override g_some_global_flag.
+///     {
+///         jg::state_scope_override<bool> _(g_some_global_flag, false);
+///         TEST_ASSERT(perform_action());
+///     }
+template <typename T>
+class overridable final
+{
+public:
+    template <typename... Args>
+    explicit overridable(Args&&... args)
+        : m_value(std::forward<Args>(args)...)
+    {
+    }
+
+    overridable(const overridable&) = delete;
+    overridable& operator=(const overridable&) = delete;
+
+    /// The newest override in effect on the calling thread, or else the global value.
+    const T& get() const
+    {
+        const auto* overrides = detail::thread_state_overrides();
+
+        if (JG_STATE_SCOPE_LIKELY(overrides == nullptr))
+            return m_value;
+
+        return find(overrides);
+    }
+
+    operator const T&() const { return get(); }
+
+    /// Sets the global value, which is seen by the threads that don't override it.
+    template <typename U>
+    void set(U&& value)
+    {
+        m_value = std::forward<U>(value);
+    }
+
+private:
+    const T& find(const detail::state_override* overrides) const
+    {
+        for (; overrides; overrides = overrides->next)
+            if (overrides->instance == this)
+                return *static_cast<const T*>(overrides->value);
+
+        return m_value;
+    }
+
+    T m_value;
+};
+
+/// @class jg::state_scope_override
+///
+/// Overrides a `jg::overridable` for the calling thread during the scope of a test, like
+/// `jg::state_scope_value` changes a global value for all threads. Other threads keep seeing the
+/// global value, or their own overrides, so tests that override the same global state can run
+/// concurrently. Overrides of the same `jg::overridable` nest, and the newest one is in effect.
+///
+/// An override must be destroyed on the thread that made it, which it is when it's a local
+/// variable in a test.
+///
+/// @example
+///
+///     extern jg::overridable<std::string> g_data_directory;
+///
+///     TEST()
+///     {
+///         // Naming it '_' emphasizes its unused-ness.
+///         jg::state_scope_override<std::string> _(g_data_directory, make_temporary_directory());
+///
+///         // load_settings() depends on g_data_directory.
+///         TEST_ASSERT(load_settings());
+///     }
+template <typename T>
+class state_scope_override final
+{
+public:
+    /// @param instance The `jg::overridable<T>` that's overridden in the scope of a `jg::state_scope_override` instance.
+    /// @param value Value seen by the calling thread, when it reads `instance`, instead of the global value.
+    template <typename U>
+    state_scope_override(const overridable<T>& instance, U&& value)
+        : m_value(std::forward<U>(value))
+        , m_override{&instance, &m_value, detail::thread_state_overrides()}
+    {
+        detail::thread_state_overrides() = &m_override;
+    }
+
+    ~state_scope_override()
+    {
+        // Usually the newest override, but scopes that don't nest strictly are handled too.
+        for (auto** link = &detail::thread_state_overrides(); *link; link = &(*link)->next)
+            if (*link == &m_override)
+            {
+                *link = m_override.next;
+                break;
+            }
+    }
+
+    state_scope_override(const state_scope_override&) = delete;
+    state_scope_override& operator=(const state_scope_override&) = delete;
+
+private:
+    T m_value;
+    detail::state_override m_override;
+};
+
 } // namespace jg
@@ -1,23 +1,215 @@
 #pragma once
 
+#include <algorithm>
+#include <cstddef>
 #include <string>
+#include <type_traits>
+
+#if __cplusplus >= 201703L
+#include <string_view>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define JG_STRING_SSE2
+#include <emmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
 
 namespace jg
 {
+namespace detail
+{
+
+// The default trimmed characters, "\t\n\v\f\r ", which are the ASCII whitespace that `std::isspace`
+// classifies as whitespace in the "C" locale. Classified with two comparisons rather than a search
+// in a string of the characters.
+constexpr bool is_trim_space(char c)
+{
+    return c == ' ' || static_cast<unsigned char>(static_cast<unsigned char>(c) - '\t') <= '\r' - '\t';
+}
+
+#ifdef JG_STRING_SSE2
+
+// A bit per character of the 16 characters at `chars`, that's set for the default trimmed characters.
+inline unsigned space_mask(const char* chars)
+{
+    const auto block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(chars));
+    const auto offset = _mm_sub_epi8(block, _mm_set1_epi8('\t'));
+    const auto control = _mm_cmpeq_epi8(_mm_min_epu8(offset, _mm_set1_epi8('\r' - '\t')), offset);
+    const auto space = _mm_cmpeq_epi8(block, _mm_set1_epi8(' '));
+    return static_cast<unsigned>(_mm_movemask_epi8(_mm_or_si128(control, space)));
+}
+
+inline unsigned lowest_bit(unsigned mask)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return static_cast<unsigned>(index);
+#else
+    return static_cast<unsigned>(__builtin_ctz(mask));
+#endif
+}
+
+inline unsigned highest_bit(unsigned mask)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanReverse(&index, mask);
+    return static_cast<unsigned>(index);
+#else
+    return static_cast<unsigned>(31 - __builtin_clz(mask));
+#endif
+}
+
+#endif
+
+// The number of default trimmed characters at the beginning of `data`. A string that doesn't begin with
+// one costs a single comparison, and long runs of them, like padding, are classified 16 at a time.
+inline size_t leading_spaces(const char* data, size_t size)
+{
+    size_t begin = 0;
+
+#ifdef JG_STRING_SSE2
+    if (size >= 16 && is_trim_space(data[0]))
+        for (; begin + 16 <= size; begin += 16)
+        {
+            const auto mask = space_mask(data + begin);
+
+            if (mask != 0xffff)
+                return begin + lowest_bit(~mask & 0xffff);
+        }
+#endif
+
+    while (begin < size && is_trim_space(data[begin]))
+        ++begin;
+
+    return begin;
+}
+
+// The size of `data` without the default trimmed characters at its end.
+inline size_t size_without_trailing_spaces(const char* data, size_t size)
+{
+    size_t end = size;
+
+#ifdef JG_STRING_SSE2
+    if (size >= 16 && is_trim_space(data[size - 1]))
+        for (; end >= 16; end -= 16)
+        {
+            const auto mask = space_mask(data + end - 16);
+
+            if (mask != 0xffff)
+                return end - 16 + highest_bit(~mask & 0xffff) + 1;
+        }
+#endif
+
+    while (end > 0 && is_trim_space(data[end - 1]))
+        --end;
+
+    return end;
+}
+
+} // namespace detail
+
+/// Removes the ASCII whitespace, "\t\n\v\f\r ", from the beginning of `string`, in place.
+inline std::string& trim_left(std::string& string)
+{
+    return string.erase(0, detail::leading_spaces(string.data(), string.size()));
+}
+
+inline std::string& trim_left(std::string& string, const std::string& chars)
+{
+    return string.erase(0, string.find_first_not_of(chars));
+}
 
-inline std::string& trim_left(std::string& string, const std::string& chars = "\t\n\v\f\r ")
+inline std::string& trim_left(std::string& string, const char* chars)
 {
     return string.erase(0, string.find_first_not_of(chars));
 }
- 
-inline std::string& trim_right(std::string& string, const std::string& chars = "\t\n\v\f\r ")
+
+/// Removes the ASCII whitespace, "\t\n\v\f\r ", from the end of `string`, in place.
+inline std::string& trim_right(std::string& string)
+{
+    return string.erase(detail::size_without_trailing_spaces(string.data(), string.size()));
+}
+
+inline std::string& trim_right(std::string& string, const std::string& chars)
+{
+    return string.erase(string.find_last_not_of(chars) + 1);
+}
+
+inline std::string& trim_right(std::string& string, const char* chars)
 {
     return string.erase(string.find_last_not_of(chars) + 1);
 }
- 
-inline std::string& trim(std::string& string, const std::string& chars = "\t\n\v\f\r ")
+
+/// Removes the ASCII whitespace, "\t\n\v\f\r ", from both ends of `string`, in place.
+inline std::string& trim(std::string& string)
+{
+    return trim_left(trim_right(string));
+}
+
+inline std::string& trim(std::string& string, const std::string& chars)
+{
+    return trim_left(trim_right(string, chars), chars);
+}
+
+inline std::string& trim(std::string& string, const char* chars)
 {
     return trim_left(trim_right(string, chars), chars);
 }
 
+#if __cplusplus >= 201703L
+
+/// Returns `string` without the ASCII whitespace, "\t\n\v\f\r ", at its beginning. Nothing is copied or
+/// allocated, and the returned view is into the same characters as `string`.
+inline std::string_view trim_left(std::string_view string)
+{
+    string.remove_prefix(detail::leading_spaces(string.data(), string.size()));
+    return string;
+}
+
+inline std::string_view trim_left(std::string_view string, std::string_view chars)
+{
+    string.remove_prefix(std::min(string.find_first_not_of(chars), string.size()));
+    return string;
+}
+
+/// Returns `string` without the ASCII whitespace, "\t\n\v\f\r ", at its end, like `trim_left(string)`.
+inline std::string_view trim_right(std::string_view string)
+{
+    return string.substr(0, detail::size_without_trailing_spaces(string.data(), string.size()));
+}
+
+inline std::string_view trim_right(std::string_view string, std::string_view chars)
+{
+    return string.substr(0, string.find_last_not_of(chars) + 1);
+}
+
+/// Returns `string` without the ASCII whitespace, "\t\n\v\f\r ", at both ends, like `trim_left(string)`.
+inline std::string_view trim(std::string_view string)
+{
+    return trim_left(trim_right(string));
+}
+
+inline std::string_view trim(std::string_view string, std::string_view chars)
+{
+    return trim_left(trim_right(string, chars), chars);
+}
+
+/// A view of a temporary `std::string` would dangle, so trimming one is a compilation error. Trimming a
+/// `std::string` lvalue uses the in place overloads.
+template <typename String, typename = std::enable_if_t<std::is_same<String, std::string>::value>>
+std::string_view trim_left(String&& string, std::string_view chars = {}) = delete;
+
+template <typename String, typename = std::enable_if_t<std::is_same<String, std::string>::value>>
+std::string_view trim_right(String&& string, std::string_view chars = {}) = delete;
+
+template <typename String, typename = std::enable_if_t<std::is_same<String, std::string>::value>>
+std::string_view trim(String&& string, std::string_view chars = {}) = delete;
+
+#endif
+
 }
@@ -1,48 +1,376 @@
 #pragma once
 
-#ifndef NDEBUG
-#include <cassert>
-#include "jg_stacktrace.h"
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// The failure path, which reports through `jg::async_verify_failure_sink` and `jg_stacktrace.h`, is in
+// `jg_verify_async.h`, which this header includes at its end, so that the failure path is defined inline
+// in every translation unit by default. If JG_VERIFY_SEPARATE_IMPLEMENTATION is defined, then it's only
+// declared, none of the threading and platform headers of the failure path are included, and it's
+// defined once, in the translation unit that defines JG_VERIFY_IMPLEMENTATION, see `src/jg_verify.cpp`.
+#if defined(JG_VERIFY_IMPLEMENTATION)
+#define JG_VERIFY_DEFINE_FAILURE_PATH
+#define JG_VERIFY_INLINE
+#elif !defined(JG_VERIFY_SEPARATE_IMPLEMENTATION)
+#define JG_VERIFY_DEFINE_FAILURE_PATH
+#define JG_VERIFY_INLINE inline
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define JG_VERIFY_LIKELY(condition) __builtin_expect(!!(condition), 1)
+#define JG_VERIFY_COLD __attribute__((noinline, cold))
+#define JG_VERIFY_ALWAYS_INLINE __attribute__((always_inline)) inline
+#elif defined(_MSC_VER)
+#define JG_VERIFY_LIKELY(condition) (!!(condition))
+#define JG_VERIFY_COLD __declspec(noinline)
+#define JG_VERIFY_ALWAYS_INLINE __forceinline
+#else
+#define JG_VERIFY_LIKELY(condition) (!!(condition))
+#define JG_VERIFY_COLD
+#define JG_VERIFY_ALWAYS_INLINE inline
+#endif
+
+#ifndef JG_VERIFY_REPORT_FIRST
+/// The number of failures per verification site that are reported with a stack trace, before the
+/// reports are limited to one every `JG_VERIFY_REPORT_EVERY` failures.
+#define JG_VERIFY_REPORT_FIRST 10
+#endif
+
+#ifndef JG_VERIFY_REPORT_EVERY
+#define JG_VERIFY_REPORT_EVERY 10000
+#endif
+
+#ifndef JG_VERIFY_CALL_SITE_COUNT
+/// The number of `jg::verify` and `jg::verified` call sites that get failure counters of their own.
+/// The failures of any further call sites are counted together, in a site without a location.
+#define JG_VERIFY_CALL_SITE_COUNT 256
+#endif
+
+// The location of the call of `jg::verify`, as default arguments, where the compiler supports it.
+#if (defined(__GNUC__) && !defined(__clang__)) || (defined(_MSC_VER) && _MSC_VER >= 1926)
+#define JG_VERIFY_CALLER_FILE __builtin_FILE()
+#define JG_VERIFY_CALLER_LINE __builtin_LINE()
+#elif defined(__clang__) && defined(__has_builtin)
+#if __has_builtin(__builtin_FILE) && __has_builtin(__builtin_LINE)
+#define JG_VERIFY_CALLER_FILE __builtin_FILE()
+#define JG_VERIFY_CALLER_LINE __builtin_LINE()
+#endif
+#endif
+
+#ifndef JG_VERIFY_CALLER_FILE
+#define JG_VERIFY_CALLER_FILE nullptr
+#define JG_VERIFY_CALLER_LINE 0
 #endif
 
 namespace jg
 {
 
+/// The failure count of a verification site, see `jg::verify_site_stats()`. `expression` is null for
+/// the call sites of `jg::verify` and `jg::verified`, and `file` is null for the site that counts the
+/// failures of the call sites beyond `JG_VERIFY_CALL_SITE_COUNT`, or of all of them if the compiler
+/// can't tell the location of the call.
+struct verify_site_statistics final
+{
+    const char* file;
+    int line;
+    const char* expression;
+    std::uint64_t failures;
+};
+
+/// A reported verification failure, see `jg::verify_failure_sink`. `file` and `expression` are like
+/// in `jg::verify_site_statistics`. `failures` is the failure count of the site,
+/// including this one. `addresses` is the raw stack trace of the failing thread, which can be
+/// symbolized with `jg::symbolize(addresses, address_count)`.
+struct verify_failure final
+{
+    const char* file;
+    int line;
+    const char* expression;
+    std::uint64_t failures;
+    void* const* addresses;
+    size_t address_count;
+};
+
+/// @class jg::verify_failure_sink
+///
+/// Receives the failures reported by `jg::verify` and `JG_VERIFY`, see `jg::set_verify_failure_sink()`.
+///
+/// `write` is called on the failing thread, and `failure` is only valid during the call, so a sink
+/// should copy what it needs and return quickly. `flush` is called after `write` when the failure
+/// is about to terminate the process, and should return when the written failures are output.
+class verify_failure_sink
+{
+public:
+    virtual ~verify_failure_sink() = default;
+
+    virtual void write(const verify_failure& failure) = 0;
+    virtual void flush() {}
+};
+
+/// Makes `sink` receive the reported verification failures, or restores the default sink if `sink`
+/// is null. The default sink is a `jg::async_verify_failure_sink`, see `jg_verify_async.h`, that
+/// writes to `stderr`. Returns
+/// the previous sink, or null if it was the default one. The caller keeps the ownership of `sink`,
+/// which must outlive its use.
+inline verify_failure_sink* set_verify_failure_sink(verify_failure_sink* sink);
+
+namespace detail
+{
+
+inline std::atomic<verify_failure_sink*>& custom_verify_failure_sink()
+{
+    static std::atomic<verify_failure_sink*> sink{nullptr};
+    return sink;
+}
+
+// A verification site has static storage duration and is constant initialized, so it doesn't need
+// any guard. It's added to the list of failed sites by its first failure.
+class verify_site final
+{
+public:
+    constexpr verify_site(const char* file, int line, const char* expression)
+        : m_file{file}
+        , m_line{line}
+        , m_expression{expression}
+    {
+    }
+
+    verify_site(const verify_site&) = delete;
+    verify_site& operator=(const verify_site&) = delete;
+
+    const char* file() const { return m_file; }
+    int line() const { return m_line; }
+    const char* expression() const { return m_expression; }
+    std::uint64_t failures() const { return m_failures.load(std::memory_order_relaxed); }
+    const verify_site* next() const { return m_next; }
+
+    /// Counts a failure and returns the total failure count, including this one.
+    std::uint64_t fail();
+
+    /// Sets the location of a site of `jg::verify_call_site()`, before its first failure.
+    void locate(const char* file, int line)
+    {
+        m_file = file;
+        m_line = line;
+    }
+
+    static const verify_site* first() { return failed_sites().load(std::memory_order_acquire); }
+
+private:
+    static std::atomic<verify_site*>& failed_sites()
+    {
+        static std::atomic<verify_site*> sites{nullptr};
+        return sites;
+    }
+
+    const char* m_file;
+    int m_line;
+    const char* m_expression;
+    std::atomic<std::uint64_t> m_failures{0};
+    verify_site* m_next = nullptr;
+};
+
+inline std::uint64_t verify_site::fail()
+{
+    const auto failures = m_failures.fetch_add(1, std::memory_order_relaxed) + 1;
+
+    if (failures == 1)
+    {
+        auto& sites = failed_sites();
+        m_next = sites.load(std::memory_order_relaxed);
+
+        while (!sites.compare_exchange_weak(m_next, this, std::memory_order_release, std::memory_order_relaxed))
+            ;
+    }
+
+    return failures;
+}
+
+// A site of `jg::verify` and `jg::verified` call sites, which is claimed by the first failure of a call
+// site: `state` goes from empty to claimed to located, and the location is written in between.
+struct verify_call_site_slot final
+{
+    static constexpr int empty = 0;
+    static constexpr int claimed = 1;
+    static constexpr int located = 2;
+
+    std::atomic<int> state{empty};
+    verify_site site{nullptr, 0, nullptr};
+};
+
+// Returns the site of the `jg::verify` call at `file` and `line`, from a lock-free open addressing
+// table. The same file can have several names, from the translation units of an inline function, so
+// the names are compared as strings. The table is constant initialized, like the `JG_VERIFY` sites.
+JG_VERIFY_COLD inline verify_site& verify_call_site(const char* file, int line)
+{
+    static verify_site unlocated{nullptr, 0, nullptr};
+    static verify_call_site_slot sites[JG_VERIFY_CALL_SITE_COUNT];
+
+    if (!file)
+        return unlocated;
+
+    auto hash = static_cast<std::uint32_t>(line) * 0x9e3779b9u;
+
+    for (auto c = file; *c; ++c)
+        hash = (hash ^ static_cast<unsigned char>(*c)) * 0x01000193u;
+
+    for (size_t i = 0; i < JG_VERIFY_CALL_SITE_COUNT; ++i)
+    {
+        auto& slot = sites[(hash + i) % JG_VERIFY_CALL_SITE_COUNT];
+        auto state = slot.state.load(std::memory_order_acquire);
+
+        if (state == verify_call_site_slot::empty &&
+            slot.state.compare_exchange_strong(state, verify_call_site_slot::claimed, std::memory_order_acquire))
+        {
+            slot.site.locate(file, line);
+            slot.state.store(verify_call_site_slot::located, std::memory_order_release);
+            return slot.site;
+        }
+
+        // Another thread is writing the location, which is only two stores away.
+        while (state == verify_call_site_slot::claimed)
+            state = slot.state.load(std::memory_order_acquire);
+
+        if (slot.site.line() == line && std::strcmp(slot.site.file(), file) == 0)
+            return slot.site;
+    }
+
+    return unlocated;
+}
+
+inline bool verify_report_due(std::uint64_t failures)
+{
+    return failures <= JG_VERIFY_REPORT_FIRST || (failures - JG_VERIFY_REPORT_FIRST) % JG_VERIFY_REPORT_EVERY == 0;
+}
+
+} // namespace detail
+
+inline verify_failure_sink* set_verify_failure_sink(verify_failure_sink* sink)
+{
+    return detail::custom_verify_failure_sink().exchange(sink);
+}
+
+namespace detail
+{
+
+/// The failure path of `jg::verify` and `JG_VERIFY`. It's kept out of line, and out of the hot code
+/// section where the compiler supports it, so that a passing verification costs a single predicted
+/// branch at the call site. Only the first `JG_VERIFY_REPORT_FIRST` failures of a site, and then one
+/// every `JG_VERIFY_REPORT_EVERY`, are reported, so that a broken invariant on a hot path in a checked
+/// release build doesn't swamp the process with stack traces. It's defined in `jg_verify_async.h`.
+#ifdef JG_VERIFY_DEFINE_FAILURE_PATH
+void verify_failed(verify_site& site); // Only the definition is inline and cold, which GCC requires.
+#else
+JG_VERIFY_COLD void verify_failed(verify_site& site);
+#endif
+
+// Follows every call of `verify_failed`, so that the call is never compiled as a tail call. The return
+// address of a tail call is the one of the caller's caller, so the function of the failed verification
+// would be missing from the stack trace.
+JG_VERIFY_ALWAYS_INLINE void prevent_tail_call()
+{
+#if defined(__GNUC__) || defined(__clang__)
+    __asm__ __volatile__("" ::: "memory");
+#else
+    volatile char barrier = 0;
+    (void)barrier;
+#endif
+}
+
+} // namespace detail
+
+/// Returns every verification site that has failed, with its failure count, for instance to export
+/// them as metrics. Counting is lock free, and so is this, which is safe to call at any time.
+inline std::vector<verify_site_statistics> verify_site_stats()
+{
+    std::vector<verify_site_statistics> statistics;
+
+    for (auto site = detail::verify_site::first(); site; site = site->next())
+        statistics.push_back({site->file(), site->line(), site->expression(), site->failures()});
+
+    return statistics;
+}
+
 /// Verifies that `condition` evaluates to `true`.
 ///
 /// If `condition` is `false` and...
 ///
-///   * JG_VERIFY_ENABLE_STACK_TRACE is defined, or NDEBUG isn't defined, then a stack trace is written to `stdout`,
+///   * JG_VERIFY_ENABLE_STACK_TRACE is defined, or NDEBUG isn't defined, then a stack trace is reported to the
+///     `jg::verify_failure_sink`, which writes it to `stderr` by default,
 ///   * JG_VERIFY_ENABLE_TERMINATE is defined, then `std::terminate()` is called,
-///   * JG_VERIFY_ENABLE_TERMINATE isn't defined, then `assert(condition)` fails (which is a no-op if NDEBUG is defined).
+///   * JG_VERIFY_ENABLE_TERMINATE isn't defined, then `std::abort()` is called like by a failing `assert(condition)`
+///     (which is a no-op if NDEBUG is defined).
 ///
 /// If NDEBUG is defined and neither JG_VERIFY_ENABLE_STACK_TRACE nor JG_VERIFY_ENABLE_TERMINATE is defined, then
 /// this function will be a no-op in an optimized build.
 ///
 /// The compilation flags JG_VERIFY_ENABLE_STACK_TRACE and JG_VERIFY_ENABLE_TERMINATE enables a "checked release" build
 /// configuration which is optimized, but still fails fast and hard in tests.
-inline void verify(bool condition)
+///
+/// If JG_VERIFY_SEPARATE_IMPLEMENTATION is defined, then the failure path is compiled once, by
+/// `src/jg_verify.cpp`, and this header doesn't include `jg_verify_async.h`, `jg_stacktrace.h` and
+/// their threading and platform headers, neither in the translation units that use `jg::verify` nor in
+/// those that use `jg_mock.h`. Build
+/// `src/jg_verify.cpp` with the same NDEBUG and JG_VERIFY_* flags as the rest of the program.
+///
+/// Each call site has a failure counter of its own, and reports its file and line, where the compiler can
+/// tell them (GCC, Clang 9 and later, and Visual Studio 2019 16.6 and later). `file` and `line` are the
+/// location of the call, and aren't meant to be passed explicitly.
+///
+/// Prefer `JG_VERIFY(condition)`, which also reports the failed expression.
+inline void verify(bool condition, const char* file = JG_VERIFY_CALLER_FILE, int line = JG_VERIFY_CALLER_LINE)
 {
-#if defined(JG_VERIFY_ENABLE_STACK_TRACE) || !defined(NDEBUG)
-    if (!condition)
-        for (const auto& stack_frame : jg::stack_trace().include_frame_count(10).skip_frame_count(1).capture())
-            std::cout << stack_frame << "\n";
-#endif
-
-#ifdef JG_VERIFY_ENABLE_TERMINATE
-    if (!condition)
-        std::terminate();
+#if defined(JG_VERIFY_ENABLE_STACK_TRACE) || defined(JG_VERIFY_ENABLE_TERMINATE) || !defined(NDEBUG)
+    if (!JG_VERIFY_LIKELY(condition))
+    {
+        detail::verify_failed(detail::verify_call_site(file, line));
+        detail::prevent_tail_call();
+    }
 #else
-    assert(condition);
+    (void)condition;
+    (void)file;
+    (void)line;
 #endif
 }
 
 /// Calls `verify(ptr)` and returns `ptr`. Will be a no-op when `verify(ptr)` is a no-op.
 template <typename T>
-inline T* verified(T* ptr)
+inline T* verified(T* ptr, const char* file = JG_VERIFY_CALLER_FILE, int line = JG_VERIFY_CALLER_LINE)
 {
-    verify(ptr);
+    verify(ptr, file, line);
     return ptr;
 }
 
 } // namespace jg
+
+/// Verifies that `condition` evaluates to `true`, like `jg::verify(condition)`, and additionally
+/// reports `__FILE__`, `__LINE__` and the text of `condition` when it fails, so that the failure is
+/// useful even without a stack trace.
+///
+/// `condition` is always evaluated exactly once. The passing case is a single branch that's
+/// predicted taken, and everything else is in `jg::detail::verify_failed`, which is never inlined.
+/// Every use of `JG_VERIFY` is a site of its own in `jg::verify_site_stats()`, like every call site of
+/// `jg::verify`.
+///
+/// @example
+///
+///     JG_VERIFY(index < size);
+#if defined(JG_VERIFY_ENABLE_STACK_TRACE) || defined(JG_VERIFY_ENABLE_TERMINATE) || !defined(NDEBUG)
+#define JG_VERIFY(condition) \
+    (JG_VERIFY_LIKELY(condition) \
+        ? static_cast<void>(0) \
+        : (::jg::detail::verify_failed([]() -> ::jg::detail::verify_site& \
+           { \
+               static ::jg::detail::verify_site site{__FILE__, __LINE__, #condition}; \
+               return site; \
+           }()), \
+           ::jg::detail::prevent_tail_call()))
+#else
+#define JG_VERIFY(condition) static_cast<void>(condition)
+#endif
+
+#ifdef JG_VERIFY_DEFINE_FAILURE_PATH
+#include "jg_verify_async.h"
+#endif
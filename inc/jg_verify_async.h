@@ -0,0 +1,354 @@
+#pragma once
+
+#include "jg_verify.h"
+
+#if defined(JG_VERIFY_ENABLE_STACK_TRACE) || !defined(NDEBUG)
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#ifdef JG_VERIFY_DEFINE_FAILURE_PATH
+#include <algorithm>
+#include "jg_stacktrace.h"
+#endif
+#endif
+
+#ifdef JG_VERIFY_DEFINE_FAILURE_PATH
+#include <cstdlib>
+#include <exception>
+#endif
+
+//
+// The failure path of `jg::verify` and `JG_VERIFY`, and `jg::async_verify_failure_sink`, which it
+// reports through by default. `jg_verify.h` includes this header, unless JG_VERIFY_SEPARATE_IMPLEMENTATION
+// is defined, in which case only `src/jg_verify.cpp` includes it for the definitions, and the
+// translation units of the program don't pay for its threading and platform headers. A program that
+// constructs a sink of its own includes it, and the members of the sink are then defined by
+// `src/jg_verify.cpp`.
+//
+
+namespace jg
+{
+
+#if defined(JG_VERIFY_ENABLE_STACK_TRACE) || !defined(NDEBUG)
+
+namespace detail
+{
+
+constexpr size_t verify_trace_frame_count = 10;
+
+#ifdef JG_VERIFY_DEFINE_FAILURE_PATH
+
+inline void format_verify_failure(const verify_failure& failure, std::string& report)
+{
+    char number[20];
+
+    if (failure.file)
+    {
+        report.append(failure.file);
+        report.push_back('(');
+        report.append(number, format_number(static_cast<std::uint64_t>(failure.line), 10, number));
+        report.append("): verify");
+
+        if (failure.expression)
+        {
+            report.push_back('(');
+            report.append(failure.expression);
+            report.push_back(')');
+        }
+
+        report.append(" failed");
+    }
+    else
+        report.append("verify failed");
+
+    if (failure.failures > 1)
+    {
+        report.append(" (failure ");
+        report.append(number, format_number(failure.failures, 10, number));
+        report.append(")");
+    }
+
+    if (failure.failures == JG_VERIFY_REPORT_FIRST)
+    {
+        report.append(", further failures are reported once every ");
+        report.append(number, format_number(JG_VERIFY_REPORT_EVERY, 10, number));
+    }
+
+    report.push_back('\n');
+    format_stack_trace(symbolize(failure.addresses, failure.address_count), report);
+}
+
+#endif
+
+} // namespace detail
+
+/// @class jg::async_verify_failure_sink
+///
+/// A `jg::verify_failure_sink` that copies the failures into a fixed size lock-free ring buffer,
+/// which a background thread drains by symbolizing and writing them to a `FILE`. The failing thread
+/// only spends the time it takes to copy the raw stack trace, and it never blocks, unless the
+/// process is about to terminate and it waits for its own report to be written. When the ring
+/// buffer is full, failures are dropped, and the number of dropped failures is reported instead.
+///
+/// The ring buffer is Dmitry Vyukov's bounded queue, where each slot has a sequence number that
+/// tells whether it's free or written. The background thread is started by the constructor, and
+/// the destructor waits for it to write the failures that are already in the ring buffer.
+///
+/// @example
+///
+///     static jg::async_verify_failure_sink sink{std::fopen("verify.log", "w")};
+///     jg::set_verify_failure_sink(&sink);
+class async_verify_failure_sink final : public verify_failure_sink
+{
+public:
+    /// `output` isn't closed by the sink.
+    explicit async_verify_failure_sink(std::FILE* output = stderr);
+    ~async_verify_failure_sink() override;
+
+    async_verify_failure_sink(const async_verify_failure_sink&) = delete;
+    async_verify_failure_sink& operator=(const async_verify_failure_sink&) = delete;
+
+    void write(const verify_failure& failure) override;
+    void flush() override;
+
+private:
+    static constexpr size_t slot_count = 64;
+
+    struct slot final
+    {
+        std::atomic<size_t> sequence{0};
+        verify_failure failure{};
+        std::array<void*, detail::verify_trace_frame_count> addresses{};
+    };
+
+    void run();
+    bool pop(verify_failure& failure, std::array<void*, detail::verify_trace_frame_count>& addresses);
+    void output(const verify_failure* failure);
+
+    std::FILE* m_output;
+    std::array<slot, slot_count> m_slots;
+    std::atomic<size_t> m_enqueue_position{0};
+    size_t m_dequeue_position = 0; // Only used by the background thread.
+    std::atomic<std::uint64_t> m_dropped{0};
+    std::string m_report; // Only used by the background thread.
+
+    std::mutex m_mutex;
+    std::condition_variable m_wakeup;
+    std::condition_variable m_written_wakeup;
+    std::atomic<bool> m_waiting{false};
+    bool m_stopping = false;
+    size_t m_written = 0;
+
+    std::thread m_thread;
+};
+
+#ifdef JG_VERIFY_DEFINE_FAILURE_PATH
+
+JG_VERIFY_INLINE async_verify_failure_sink::async_verify_failure_sink(std::FILE* output)
+    : m_output{output}
+{
+    for (size_t i = 0; i < slot_count; ++i)
+        m_slots[i].sequence.store(i, std::memory_order_relaxed);
+
+    detail::construct_symbolization_singletons();
+    m_thread = std::thread([this] { run(); });
+}
+
+JG_VERIFY_INLINE async_verify_failure_sink::~async_verify_failure_sink()
+{
+    {
+        std::lock_guard<std::mutex> lock{m_mutex};
+        m_stopping = true;
+    }
+
+    m_wakeup.notify_one();
+    m_thread.join();
+}
+
+JG_VERIFY_INLINE void async_verify_failure_sink::write(const verify_failure& failure)
+{
+    auto position = m_enqueue_position.load(std::memory_order_relaxed);
+    slot* target = nullptr;
+
+    for (;;)
+    {
+        target = &m_slots[position % slot_count];
+        const auto sequence = target->sequence.load(std::memory_order_acquire);
+        const auto difference = static_cast<std::intptr_t>(sequence) - static_cast<std::intptr_t>(position);
+
+        if (difference == 0)
+        {
+            if (m_enqueue_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                break;
+        }
+        else if (difference < 0)
+        {
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        else
+            position = m_enqueue_position.load(std::memory_order_relaxed);
+    }
+
+    const auto address_count = failure.address_count < target->addresses.size() ? failure.address_count
+                                                                                 : target->addresses.size();
+    std::copy(failure.addresses, failure.addresses + address_count, target->addresses.begin());
+    target->failure = failure;
+    target->failure.address_count = address_count;
+    target->sequence.store(position + 1);
+
+    if (m_waiting.load())
+    {
+        std::lock_guard<std::mutex> lock{m_mutex};
+        m_waiting = false;
+        m_wakeup.notify_one();
+    }
+}
+
+JG_VERIFY_INLINE void async_verify_failure_sink::flush()
+{
+    const auto written = m_enqueue_position.load();
+    std::unique_lock<std::mutex> lock{m_mutex};
+    m_waiting = false;
+    m_wakeup.notify_one();
+    m_written_wakeup.wait(lock, [&] { return m_written >= written || m_stopping; });
+}
+
+JG_VERIFY_INLINE void async_verify_failure_sink::run()
+{
+    verify_failure failure{};
+    std::array<void*, detail::verify_trace_frame_count> addresses{};
+
+    for (;;)
+    {
+        if (pop(failure, addresses))
+        {
+            output(&failure);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock{m_mutex};
+        m_waiting = true;
+
+        // A failure written after the last pop, but before `m_waiting` was set, is found here.
+        if (pop(failure, addresses))
+        {
+            m_waiting = false;
+            lock.unlock();
+            output(&failure);
+            continue;
+        }
+
+        if (m_stopping)
+        {
+            lock.unlock();
+
+            if (m_dropped.load(std::memory_order_relaxed))
+                output(nullptr);
+
+            return;
+        }
+
+        m_wakeup.wait(lock, [this] { return !m_waiting || m_stopping; });
+        m_waiting = false;
+    }
+}
+
+JG_VERIFY_INLINE bool async_verify_failure_sink::pop(verify_failure& failure,
+                                           std::array<void*, detail::verify_trace_frame_count>& addresses)
+{
+    auto& source = m_slots[m_dequeue_position % slot_count];
+
+    if (source.sequence.load() != m_dequeue_position + 1)
+        return false;
+
+    failure = source.failure;
+    addresses = source.addresses;
+    failure.addresses = addresses.data();
+    source.sequence.store(m_dequeue_position + slot_count, std::memory_order_release);
+    m_dequeue_position++;
+    return true;
+}
+
+// Writes `failure`, if any, after the number of failures that were dropped since the last write.
+JG_VERIFY_INLINE void async_verify_failure_sink::output(const verify_failure* failure)
+{
+    m_report.clear();
+
+    if (const auto dropped = m_dropped.exchange(0, std::memory_order_relaxed))
+    {
+        char number[20];
+        m_report.append(number, detail::format_number(dropped, 10, number));
+        m_report.append(" verify failures were dropped, the failure sink was full\n");
+    }
+
+    if (failure)
+        detail::format_verify_failure(*failure, m_report);
+
+    std::fwrite(m_report.data(), 1, m_report.size(), m_output);
+    std::fflush(m_output);
+
+    std::lock_guard<std::mutex> lock{m_mutex};
+    m_written++;
+    m_written_wakeup.notify_all();
+}
+
+#endif
+
+#endif
+
+#ifdef JG_VERIFY_DEFINE_FAILURE_PATH
+
+namespace detail
+{
+
+JG_VERIFY_COLD JG_VERIFY_INLINE void verify_failed(verify_site& site)
+{
+    const auto failures = site.fail();
+
+#if defined(JG_VERIFY_ENABLE_STACK_TRACE) || !defined(NDEBUG)
+    if (verify_report_due(failures))
+    {
+        std::array<void*, verify_trace_frame_count> addresses;
+        const auto address_count = stack_trace()
+                                       .include_frame_count(addresses.size())
+                                       .skip_frame_count(1)
+                                       .capture(addresses.data(), addresses.size());
+
+        auto* sink = custom_verify_failure_sink().load();
+
+        if (!sink)
+        {
+            // Started on the first failure, so that processes that never fail don't get the thread.
+            static async_verify_failure_sink default_sink;
+            sink = &default_sink;
+        }
+
+        sink->write({site.file(), site.line(), site.expression(), failures, addresses.data(), address_count});
+
+#if defined(JG_VERIFY_ENABLE_TERMINATE) || !defined(NDEBUG)
+        sink->flush();
+#endif
+    }
+#else
+    (void)failures;
+#endif
+
+#ifdef JG_VERIFY_ENABLE_TERMINATE
+    std::terminate();
+#elif !defined(NDEBUG)
+    // What a failing `assert` would do, now that the location has been reported.
+    std::abort();
+#endif
+}
+
+} // namespace detail
+
+#endif
+
+} // namespace jg
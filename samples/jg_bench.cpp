@@ -0,0 +1,473 @@
+// A benchmark suite for `jg::mock`, `jg::verify`, `jg::stack_trace` and `jg::overridable`, with machine readable output so
+// that the numbers can be tracked across releases. Build optimized (e.g. CMAKE_BUILD_TYPE=Release) for
+// meaningful numbers.
+//
+// Usage: jg_bench [--format=text|csv|json] [--filter=substring] [--repetitions=N]
+//
+// Each benchmark is run N times (5 by default) and the median and the minimum time per operation are
+// reported. The JSON output uses the field names of Google Benchmark, where they apply, so that the same
+// comparison scripts can be used.
+#ifndef JG_VERIFY_ENABLE_STACK_TRACE
+#define JG_VERIFY_ENABLE_STACK_TRACE
+#endif
+
+// Every failure of a site up to this count is reported, with a stack trace, so that both the reported
+// and the rate limited failure path can be measured.
+#define JG_VERIFY_REPORT_FIRST 100000
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <ctime>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <jg_mock.h>
+#include <jg_mock_spy.h>
+#include <jg_stacktrace.h>
+#include <jg_state_scope.h>
+#include <jg_verify.h>
+
+namespace
+{
+
+volatile size_t g_sink = 0;
+size_t g_plain_global = 1;
+jg::overridable<size_t> g_overridable_global{1};
+
+struct result final
+{
+    std::string name;
+    size_t iterations;
+    size_t repetitions;
+    double median_ns;
+    double min_ns;
+};
+
+struct options final
+{
+    std::string format = "text";
+    std::string filter;
+    size_t repetitions = 5;
+};
+
+class suite final
+{
+public:
+    explicit suite(const options& options)
+        : m_options{options}
+    {
+    }
+
+    /// Times `iterations` calls of `f(i)`, `m_options.repetitions` times, unless `name` is filtered out.
+    template <typename F>
+    void run(const std::string& name, size_t iterations, F&& f, size_t operations_per_iteration = 1)
+    {
+        if (name.find(m_options.filter) == std::string::npos)
+            return;
+
+        std::vector<double> samples;
+
+        for (size_t repetition = 0; repetition < m_options.repetitions; ++repetition)
+        {
+            const auto start = std::chrono::steady_clock::now();
+
+            for (size_t i = 0; i < iterations; ++i)
+                f(i);
+
+            const auto elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start);
+            samples.push_back(elapsed.count() / (iterations * operations_per_iteration));
+        }
+
+        std::sort(samples.begin(), samples.end());
+        m_results.push_back({name, iterations * operations_per_iteration, samples.size(), samples[samples.size() / 2], samples.front()});
+
+        // Progress goes to stderr, so that the machine readable output can be redirected as is.
+        if (m_options.format != "text")
+            std::cerr << name << "\n";
+        else
+            write_text(m_results.back());
+    }
+
+    void write() const;
+
+private:
+    void write_text(const result& result) const;
+
+    options m_options;
+    std::vector<result> m_results;
+};
+
+std::string json_string(const std::string& text)
+{
+    std::string quoted = "\"";
+
+    for (const auto c : text)
+    {
+        if (c == '"' || c == '\\')
+            quoted += '\\';
+
+        quoted += c;
+    }
+
+    return quoted + "\"";
+}
+
+const char* compiler()
+{
+#if defined(__clang__)
+    return "clang " __clang_version__;
+#elif defined(__GNUC__)
+    return "gcc " __VERSION__;
+#elif defined(_MSC_VER)
+    return "msvc";
+#else
+    return "unknown";
+#endif
+}
+
+void suite::write_text(const result& result) const
+{
+    std::cout << result.name << std::string(result.name.size() < 56 ? 56 - result.name.size() : 1, ' ')
+              << result.median_ns << " ns/op (min " << result.min_ns << ")\n";
+}
+
+void suite::write() const
+{
+    if (m_options.format == "csv")
+    {
+        std::cout << "name,iterations,repetitions,median_ns,min_ns\n";
+
+        for (const auto& result : m_results)
+            std::cout << result.name << "," << result.iterations << "," << result.repetitions << ","
+                      << result.median_ns << "," << result.min_ns << "\n";
+    }
+    else if (m_options.format == "json")
+    {
+        char date[32] = {};
+        const auto now = std::time(nullptr);
+        std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&now));
+
+        std::cout << "{\n  \"context\": {\n"
+                  << "    \"date\": " << json_string(date) << ",\n"
+                  << "    \"executable\": \"jg_bench\",\n"
+                  << "    \"compiler\": " << json_string(compiler()) << ",\n"
+#ifdef NDEBUG
+                  << "    \"library_build_type\": \"release\"\n"
+#else
+                  << "    \"library_build_type\": \"debug\"\n"
+#endif
+                  << "  },\n  \"benchmarks\": [";
+
+        for (size_t i = 0; i < m_results.size(); ++i)
+        {
+            const auto& result = m_results[i];
+            std::cout << (i == 0 ? "\n" : ",\n")
+                      << "    {\"name\": " << json_string(result.name)
+                      << ", \"iterations\": " << result.iterations
+                      << ", \"repetitions\": " << result.repetitions
+                      << ", \"real_time\": " << result.median_ns
+                      << ", \"min_time\": " << result.min_ns
+                      << ", \"time_unit\": \"ns\"}";
+        }
+
+        std::cout << "\n  ]\n}\n";
+    }
+}
+
+class dependency
+{
+public:
+    virtual ~dependency() = default;
+    virtual int lookup(int key) = 0;
+};
+
+// What a mock replaces, as the baseline of a mocked call.
+class stub_dependency final : public dependency
+{
+public:
+    int lookup(int) override { return 4711; }
+};
+
+class mock_dependency final : public dependency
+{
+public:
+    JG_MOCK(,,, int, lookup, int);
+};
+
+class spy_dependency final : public dependency
+{
+public:
+    explicit spy_dependency(dependency& spied)
+    {
+        lookup_.func = [&spied](int key) { return spied.lookup(key); };
+    }
+
+    JG_SPY(,,, int, lookup, int);
+};
+
+// The parameter types whose recording cost is measured.
+struct recording_mocks final
+{
+    JG_MOCK(,,, void, take_int, int);
+    JG_MOCK(,,, void, take_string, const std::string&);
+    JG_MOCK(,,, void, take_vector, const std::vector<int>&);
+    JG_MOCK(,,, void, take_four, int, double, const char*, const std::string&);
+};
+
+// Free function mocks, with global and with thread local auxiliary data.
+JG_MOCK(,,, int, global_lookup, int);
+JG_MOCK_TLS(,,, int, thread_lookup, int);
+
+// Called through the interface, like the tested code would, and kept out of line so that the call
+// isn't devirtualized and optimized away.
+JG_STACK_TRACE_NOINLINE int call_lookup(dependency& d, int key)
+{
+    return d.lookup(key);
+}
+
+// Gives the captured stack traces a realistic depth.
+template <size_t Depth>
+struct nest final
+{
+    template <typename F>
+    JG_STACK_TRACE_NOINLINE static void call(F& f)
+    {
+        nest<Depth - 1>::call(f);
+        g_sink = g_sink + 1;
+    }
+};
+
+template <>
+struct nest<0> final
+{
+    template <typename F>
+    static void call(F& f)
+    {
+        f();
+    }
+};
+
+// Counts the reported failures instead of writing them, so that only the failure path is measured.
+class counting_sink final : public jg::verify_failure_sink
+{
+public:
+    void write(const jg::verify_failure& failure) override { g_sink = g_sink + failure.address_count; }
+};
+
+void mock_benchmarks(suite& s)
+{
+    const size_t iterations = 1000000;
+
+    stub_dependency stub;
+    s.run("mock/call/stub", iterations, [&](size_t i) { g_sink = g_sink + call_lookup(stub, static_cast<int>(i)); });
+
+    mock_dependency mock;
+    mock.lookup_.result = 4711;
+    s.run("mock/call/result", iterations, [&](size_t i) { g_sink = g_sink + call_lookup(mock, static_cast<int>(i)); });
+
+    mock.lookup_.func = [](int key) { return key + 1; };
+    s.run("mock/call/func", iterations, [&](size_t i) { g_sink = g_sink + call_lookup(mock, static_cast<int>(i)); });
+
+    // Failure injection, without delays, for the cost of the random draw.
+    mock.lookup_.inject_failures(0.01, -1);
+    s.run("mock/call/func_injected_failures", iterations, [&](size_t i) { g_sink = g_sink + call_lookup(mock, static_cast<int>(i)); });
+    mock.lookup_.inject_failures(0, 0);
+
+    // The return address of each call, into a ring buffer.
+    mock.lookup_.record_callers(1024);
+    s.run("mock/call/func_callers", iterations, [&](size_t i) { g_sink = g_sink + call_lookup(mock, static_cast<int>(i)); });
+    mock.lookup_.record_callers(0);
+
+    spy_dependency spy{stub};
+    s.run("mock/call/spy", iterations, [&](size_t i) { g_sink = g_sink + call_lookup(spy, static_cast<int>(i)); });
+
+    global_lookup_.result = 4711;
+    thread_lookup_.result = 4711;
+    s.run("mock/call/free_result", iterations, [&](size_t i) { g_sink = g_sink + global_lookup(static_cast<int>(i)); });
+    s.run("mock/call/free_result_tls", iterations, [&](size_t i) { g_sink = g_sink + thread_lookup(static_cast<int>(i)); });
+
+    // Different results per call, from a func that counts its calls and from results.
+    int counter = 0;
+    mock.lookup_.func = [&counter](int) { return counter++ % 4; };
+    s.run("mock/call/func_sequence", iterations, [&](size_t i) { g_sink = g_sink + call_lookup(mock, static_cast<int>(i)); });
+
+    mock.lookup_.func = nullptr;
+    mock.lookup_.results.assign({0, 1, 2, 3}, jg::mock_results_end::wrap_around);
+    s.run("mock/call/results", iterations, [&](size_t i) { g_sink = g_sink + call_lookup(mock, static_cast<int>(i)); });
+
+    s.run("mock/construct", iterations / 10, [&](size_t)
+    {
+        mock_dependency constructed;
+        g_sink = g_sink + constructed.lookup_.called();
+    });
+    s.run("mock/reset", iterations / 10, [&](size_t)
+    {
+        mock.lookup_.reset();
+        g_sink = g_sink + mock.lookup_.called();
+    });
+
+    // Recording, measured as calls with each capture policy and with a call history, per parameter type.
+    recording_mocks r;
+    const std::string text(64, 'x');
+    const std::string blob(4096, 'x');
+    const std::vector<int> values(1024, 1);
+
+    const std::pair<const char*, jg::mock_capture> captures[] = {
+        {"none", jg::mock_capture::none},
+        {"copy", jg::mock_capture::copy},
+        {"summary", jg::mock_capture::summary},
+    };
+
+    for (const auto& capture : captures)
+    {
+        r.take_int_.capture_params(capture.second);
+        r.take_string_.capture_params(capture.second);
+        r.take_vector_.capture_params(capture.second);
+        r.take_four_.capture_params(capture.second);
+
+        const std::string suffix = std::string{"/"} + capture.first;
+        s.run("mock/record/int" + suffix, iterations, [&](size_t i) { r.take_int(static_cast<int>(i)); });
+        s.run("mock/record/string_64" + suffix, iterations, [&](size_t) { r.take_string(text); });
+        s.run("mock/record/string_4096" + suffix, iterations / 10, [&](size_t) { r.take_string(blob); });
+        s.run("mock/record/vector_int_1024" + suffix, iterations / 10, [&](size_t) { r.take_vector(values); });
+        s.run("mock/record/four_params" + suffix, iterations, [&](size_t i) { r.take_four(static_cast<int>(i), 1.0, "", text); });
+    }
+
+    r = recording_mocks{};
+    r.take_int_.record_calls(1024);
+    r.take_string_.record_calls(1024);
+    r.take_four_.record_calls(1024);
+    s.run("mock/record/int/history", iterations, [&](size_t i) { r.take_int(static_cast<int>(i)); });
+    s.run("mock/record/string_64/history", iterations, [&](size_t) { r.take_string(text); });
+    s.run("mock/record/four_params/history", iterations, [&](size_t i) { r.take_four(static_cast<int>(i), 1.0, "", text); });
+
+    // Resetting every mock, and then the lazy reset of a mock that's used after it.
+    s.run("mock/reset_all_mocks", iterations / 10, [&](size_t)
+    {
+        jg::reset_all_mocks();
+        r.take_int_.capture_params(jg::mock_capture::copy);
+        g_sink = g_sink + r.take_int_.called();
+    });
+}
+
+void verify_benchmarks(suite& s)
+{
+    std::vector<size_t> values(4096);
+
+    for (size_t i = 0; i < values.size(); ++i)
+        values[i] = i;
+
+    const size_t limit = values.size() + g_sink;
+
+    // Per verification, in a loop that verifies an element invariant per element.
+    s.run("verify/pass/none", 1000, [&](size_t)
+    {
+        for (const auto value : values)
+            g_sink = g_sink + value % limit;
+    }, values.size());
+    s.run("verify/pass/jg::verify", 1000, [&](size_t)
+    {
+        for (const auto value : values)
+        {
+            jg::verify(value < limit);
+            g_sink = g_sink + value % limit;
+        }
+    }, values.size());
+    s.run("verify/pass/JG_VERIFY", 1000, [&](size_t)
+    {
+        for (const auto value : values)
+        {
+            JG_VERIFY(value < limit);
+            g_sink = g_sink + value % limit;
+        }
+    }, values.size());
+
+#if defined(NDEBUG) && !defined(JG_VERIFY_ENABLE_TERMINATE)
+    counting_sink sink;
+    const auto previous_sink = jg::set_verify_failure_sink(&sink);
+
+    // A failing site reports its first JG_VERIFY_REPORT_FIRST failures, and then rate limits them.
+    s.run("verify/fail/reported", 1000, [&](size_t i) { JG_VERIFY(i == limit); });
+
+    auto rate_limited = [&](size_t i) { JG_VERIFY(i == limit); };
+
+    for (size_t i = 0; i < JG_VERIFY_REPORT_FIRST; ++i)
+        rate_limited(i);
+
+    s.run("verify/fail/rate_limited", 1000000, rate_limited);
+
+    jg::set_verify_failure_sink(previous_sink);
+#else
+    // A failure terminates the process in this build configuration.
+    std::cerr << "verify/fail/* skipped, since verification failures terminate without NDEBUG\n";
+#endif
+}
+
+void stack_trace_benchmarks(suite& s)
+{
+    const auto trace = jg::stack_trace().include_frame_count(32);
+    jg::raw_stack_trace raw_trace;
+
+    auto capture_raw = [&] { raw_trace = trace.capture_raw(); };
+    auto capture = [&] { g_sink = g_sink + trace.capture().size(); };
+
+    s.run("stack_trace/capture_raw", 10000, [&](size_t) { nest<16>::call(capture_raw); });
+    s.run("stack_trace/capture/cached", 1000, [&](size_t) { nest<16>::call(capture); });
+    s.run("stack_trace/capture/uncached", 20, [&](size_t)
+    {
+        jg::clear_symbol_cache();
+        nest<16>::call(capture);
+    });
+    s.run("stack_trace/resolve/cached", 1000, [&](size_t) { g_sink = g_sink + raw_trace.resolve().size(); });
+}
+
+void state_scope_benchmarks(suite& s)
+{
+    // Reads of global state, plain and through a jg::overridable, without and with a thread override.
+    s.run("state_scope/read/plain", 100000000, [&](size_t) { g_sink = g_sink + g_plain_global; });
+    s.run("state_scope/read/overridable", 100000000, [&](size_t) { g_sink = g_sink + g_overridable_global.get(); });
+
+    const jg::state_scope_override<size_t> override{g_overridable_global, 2};
+    s.run("state_scope/read/overridable_overridden", 100000000, [&](size_t) { g_sink = g_sink + g_overridable_global.get(); });
+}
+
+bool parse(int argc, char* argv[], options& options)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string argument = argv[i];
+        const auto value = argument.substr(argument.find('=') + 1);
+
+        if (argument.compare(0, 9, "--format=") == 0 && (value == "text" || value == "csv" || value == "json"))
+            options.format = value;
+        else if (argument.compare(0, 9, "--filter=") == 0)
+            options.filter = value;
+        else if (argument.compare(0, 14, "--repetitions=") == 0 && std::strtoul(value.c_str(), nullptr, 10) > 0)
+            options.repetitions = std::strtoul(value.c_str(), nullptr, 10);
+        else
+            return false;
+    }
+
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    options options;
+
+    if (!parse(argc, argv, options))
+    {
+        std::cerr << "Usage: jg_bench [--format=text|csv|json] [--filter=substring] [--repetitions=N]\n";
+        return 1;
+    }
+
+    suite s{options};
+    mock_benchmarks(s);
+    verify_benchmarks(s);
+    stack_trace_benchmarks(s);
+    state_scope_benchmarks(s);
+    s.write();
+}
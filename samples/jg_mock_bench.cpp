@@ -0,0 +1,190 @@
+// Measures the cost of calling and assigning the `func` of a mock, against the `std::function`
+// that it replaced. Build optimized (e.g. CMAKE_BUILD_TYPE=Release) for meaningful numbers.
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <jg_mock.h>
+
+#ifdef _MSC_VER
+#define NOINLINE __declspec(noinline)
+#else
+#define NOINLINE __attribute__((noinline))
+#endif
+
+namespace
+{
+
+volatile size_t g_sink = 0;
+
+template <typename F>
+void measure(const char* name, size_t iterations, F&& f, size_t operations_per_iteration = 1)
+{
+    const auto start = std::chrono::steady_clock::now();
+
+    for (size_t i = 0; i < iterations; ++i)
+        f(i);
+
+    const auto elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start);
+    std::cout << name << ": " << elapsed.count() / (iterations * operations_per_iteration) << " ns/op\n";
+}
+
+class dependency
+{
+public:
+    virtual ~dependency() = default;
+    virtual int lookup(int key) = 0;
+    virtual int store(const std::string& blob) = 0;
+    virtual int store_all(const std::vector<std::string>& blobs) = 0;
+};
+
+class mock_dependency final : public dependency
+{
+public:
+    JG_MOCK(,,, int, lookup, int);
+    JG_MOCK(,,, int, store, const std::string&);
+    JG_MOCK(,,, int, store_all, const std::vector<std::string>&);
+};
+
+// Called through the interface, like the tested code would, and kept out of line so that the mock
+// call isn't devirtualized and optimized away.
+NOINLINE int call_lookup(dependency& d, int key)
+{
+    return d.lookup(key);
+}
+
+NOINLINE int call_store(dependency& d, const std::string& blob)
+{
+    return d.store(blob);
+}
+
+NOINLINE int call_store_all(dependency& d, const std::vector<std::string>& blobs)
+{
+    return d.store_all(blobs);
+}
+
+template <typename Function>
+NOINLINE int call_function(const Function& f, int key)
+{
+    return f(key);
+}
+
+} // namespace
+
+int main()
+{
+    std::cout << "jg_mock_bench...\n\n";
+
+    const size_t iterations = 10000000;
+    int a = 1;
+    int b = 2;
+    int c = 3;
+
+    // Captures three references, which is more than libstdc++ and libc++ std::function store inline.
+    const auto lambda = [&a, &b, &c](int key) { return key + a + b + c; };
+
+    std::function<int(int)> function = lambda;
+    jg::detail::inline_function<int(int), JG_MOCK_FUNC_CAPACITY> inline_function = lambda;
+
+    measure("call (std::function)", iterations, [&](size_t i) { g_sink = g_sink + call_function(function, static_cast<int>(i)); });
+    measure("call (inline_function)", iterations, [&](size_t i) { g_sink = g_sink + call_function(inline_function, static_cast<int>(i)); });
+
+    mock_dependency mock;
+    mock.lookup_.func = lambda;
+    measure("call (JG_MOCK func)", iterations, [&](size_t i) { g_sink = g_sink + call_lookup(mock, static_cast<int>(i)); });
+
+    mock.lookup_.func = nullptr;
+    mock.lookup_.result = 4711;
+    measure("call (JG_MOCK result)", iterations, [&](size_t i) { g_sink = g_sink + call_lookup(mock, static_cast<int>(i)); });
+
+    mock.lookup_.record_calls(1024);
+    measure("call (JG_MOCK result, call history)", iterations, [&](size_t i) { g_sink = g_sink + call_lookup(mock, static_cast<int>(i)); });
+    mock.lookup_.record_calls(0);
+
+    std::cout << "\n";
+
+    // Bulk data parameters, with the different parameter capture policies.
+    const std::string blob(4096, 'x');
+    const std::vector<std::string> blobs(64, std::string(64, 'x'));
+    mock.store_.result = 0;
+    mock.store_all_.result = 0;
+
+    const std::pair<const char*, jg::mock_capture> captures[] = {
+        {"mock_capture::copy", jg::mock_capture::copy},
+        {"mock_capture::summary", jg::mock_capture::summary},
+        {"mock_capture::none", jg::mock_capture::none},
+    };
+
+    for (const auto& capture : captures)
+    {
+        mock.store_.capture_params(capture.second);
+        mock.store_all_.capture_params(capture.second);
+
+        const auto name = std::string{capture.first};
+        measure(("call (4 KiB string, " + name + ")").c_str(), iterations / 10, [&](size_t)
+        {
+            g_sink = g_sink + call_store(mock, blob);
+        });
+        measure(("call (64 strings, " + name + ")").c_str(), iterations / 10, [&](size_t)
+        {
+            g_sink = g_sink + call_store_all(mock, blobs);
+        });
+    }
+
+    std::cout << "\n";
+
+    // Concurrent mocks, called from every hardware thread at once.
+    const auto thread_count = std::max(1u, std::thread::hardware_concurrency());
+    mock_dependency concurrent_mock;
+    concurrent_mock.lookup_.concurrent(true);
+    concurrent_mock.lookup_.func = lambda;
+
+    measure("call (concurrent JG_MOCK func, all threads)", 1, [&](size_t)
+    {
+        std::vector<std::thread> threads;
+
+        for (unsigned t = 0; t < thread_count; ++t)
+            threads.emplace_back([&]
+            {
+                for (size_t i = 0; i < iterations; ++i)
+                    g_sink = g_sink + call_lookup(concurrent_mock, static_cast<int>(i));
+            });
+
+        for (auto& thread : threads)
+            thread.join();
+    }, thread_count * iterations);
+
+    std::cout << "  (" << thread_count << " threads, " << concurrent_mock.lookup_.count() << " calls)\n\n";
+
+    measure("assign (std::function)", iterations, [&](size_t)
+    {
+        function = lambda;
+        g_sink = g_sink + static_cast<bool>(function);
+    });
+    measure("assign (inline_function)", iterations, [&](size_t)
+    {
+        inline_function = lambda;
+        g_sink = g_sink + static_cast<bool>(inline_function);
+    });
+
+    // Setting up and resetting mocks in test fixtures, per mock function.
+    std::cout << "\n";
+    measure("construct (JG_MOCK, per mock function)", iterations / 10, [&](size_t)
+    {
+        mock_dependency constructed;
+        g_sink = g_sink + constructed.lookup_.called();
+    }, 3);
+    measure("reset (JG_MOCK, per mock function)", iterations / 10, [&](size_t)
+    {
+        mock.lookup_.reset();
+        mock.store_.reset();
+        mock.store_all_.reset();
+        g_sink = g_sink + mock.lookup_.called();
+    }, 3);
+    std::cout << "  (prototype: " << mock.lookup_.prototype() << ")\n";
+
+    std::cout << "\n...done";
+}
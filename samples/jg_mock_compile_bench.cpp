@@ -0,0 +1,240 @@
+// Measures the compile time and object size of translation units with many `JG_MOCK` functions, for
+// N mocks of each of a set of arities. The translation units are generated in the current directory
+// and compiled, unoptimized, with the compiler that built this executable. Each translation unit is
+// compiled with the failure path of `jg::verify` inline, and with JG_VERIFY_SEPARATE_IMPLEMENTATION,
+// where `jg_verify.h` doesn't include `jg_verify_async.h` and `jg_stacktrace.h`, to measure what the
+// separate implementation saves. The preprocessed line count of each translation unit is reported too,
+// since it doesn't vary from run to run like the compile time does.
+//
+// `--reference=<directory>` also compiles each translation unit with the headers in `directory`, for
+// instance those of an earlier commit, as extracted with `git archive <commit> inc | tar -x -C <dir>`,
+// to compare the headers against them. The reference headers are compiled like the inline ones.
+// `--std=<standard>` sets the C++ standard, c++14 by default, for reference headers that need a later one.
+//
+// Usage: jg_mock_compile_bench [--std=<standard>] [--reference=<include directory>] [mocks per translation unit] [arity...]
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#ifndef JG_MOCK_COMPILE_BENCH_CXX
+#error JG_MOCK_COMPILE_BENCH_CXX must be defined as the path of the C++ compiler
+#endif
+
+#ifndef JG_MOCK_COMPILE_BENCH_INCLUDE
+#error JG_MOCK_COMPILE_BENCH_INCLUDE must be defined as the path of the jg headers
+#endif
+
+namespace
+{
+
+struct param_type final
+{
+    const char* declaration;
+    const char* argument;
+};
+
+// Rotated through by the generated mocks, after a first parameter of a type of their own, so that each
+// mock function has a signature of its own, like the mocked interfaces of a large test program do.
+const param_type param_types[] =
+{
+    {"int", "1"},
+    {"const std::string&", "std::string{}"},
+    {"double", "2.0"},
+    {"const char*", "\"\""},
+    {"const std::vector<int>&", "std::vector<int>{}"},
+    {"size_t", "3"},
+    {"bool", "true"},
+    {"std::string", "std::string{}"},
+};
+
+const size_t param_type_count = sizeof(param_types) / sizeof(param_types[0]);
+
+// A translation unit with `mocks` mock functions of `arity` parameters in a mock class, and a function
+// calling each of them once, so that the call path is instantiated too.
+std::string generate(size_t mocks, size_t arity)
+{
+    std::string source = "#include <string>\n#include <vector>\n#include <jg_mock.h>\n\nnamespace\n{\n\n";
+
+    for (size_t i = 0; i < mocks && arity > 0; ++i)
+        source += "struct record" + std::to_string(i) + " final {};\n";
+
+    source += "\nstruct mocks final\n{\n";
+
+    for (size_t i = 0; i < mocks; ++i)
+    {
+        source += "    JG_MOCK(,,, int, f" + std::to_string(i) + ",";
+
+        for (size_t p = 0; p < arity; ++p)
+            source += p == 0 ? " const record" + std::to_string(i) + "&"
+                             : std::string(", ") + param_types[(i + p * 3) % param_type_count].declaration;
+
+        source += ");\n";
+    }
+
+    source += "};\n\n} // namespace\n\nint call_mocks()\n{\n    mocks m;\n    int sum = 0;\n";
+
+    for (size_t i = 0; i < mocks; ++i)
+    {
+        const auto name = "f" + std::to_string(i);
+        source += "    m." + name + "_.result = 0;\n    sum += m." + name + "(";
+
+        for (size_t p = 0; p < arity; ++p)
+            source += p == 0 ? "record" + std::to_string(i) + "{}"
+                             : std::string(", ") + param_types[(i + p * 3) % param_type_count].argument;
+
+        source += ");\n";
+    }
+
+    source += "    return sum;\n}\n";
+    return source;
+}
+
+std::string quoted(const std::string& text)
+{
+    return "\"" + text + "\"";
+}
+
+// The headers that a translation unit is compiled with, see the usage at the top of this file.
+struct variant final
+{
+    const char* name;
+    std::string include;
+    bool separate;
+};
+
+std::string standard = "c++14";
+
+enum class step
+{
+    preprocess,  // Into `output_path`.
+    syntax_only,
+    compile,     // Into the object file `output_path`.
+};
+
+// Runs `source_path` through `step`, and returns the elapsed seconds, or a negative number if it fails.
+double compile(const std::string& source_path, const std::string& output_path, step step, const variant& headers)
+{
+#ifdef _MSC_VER
+    const std::string flags = " /nologo /std:" + standard + " /Zc:__cplusplus /EHsc " + (headers.separate ? "/DJG_VERIFY_SEPARATE_IMPLEMENTATION " : "");
+    const std::string mode = step == step::preprocess  ? "/E "
+                           : step == step::syntax_only ? "/Zs "
+                                                       : "/c /Fo" + quoted(output_path) + " ";
+    const std::string output = step == step::preprocess ? " > " + quoted(output_path) + " 2> NUL" : " > NUL";
+    std::string command = quoted(JG_MOCK_COMPILE_BENCH_CXX) + flags + "/I" + quoted(headers.include) + " " + mode + quoted(source_path) + output;
+    command = "\"" + command + "\""; // cmd.exe strips the outermost quotes.
+#else
+    const std::string flags = " -std=" + standard + " " + (headers.separate ? "-DJG_VERIFY_SEPARATE_IMPLEMENTATION " : "");
+    const std::string mode = step == step::preprocess  ? "-E -o " + quoted(output_path) + " "
+                           : step == step::syntax_only ? "-fsyntax-only "
+                                                       : "-c -o " + quoted(output_path) + " ";
+    const std::string command = quoted(JG_MOCK_COMPILE_BENCH_CXX) + flags + "-I" + quoted(headers.include) + " " + mode + quoted(source_path);
+#endif
+
+    const auto start = std::chrono::steady_clock::now();
+
+    if (std::system(command.c_str()) != 0)
+        return -1;
+
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+size_t file_size(const std::string& path)
+{
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    return file ? static_cast<size_t>(file.tellg()) : 0;
+}
+
+size_t line_count(const std::string& path)
+{
+    std::ifstream file(path, std::ios::binary);
+    return static_cast<size_t>(std::count(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>(), '\n'));
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    const std::string reference_option = "--reference=";
+    const std::string standard_option = "--std=";
+    std::vector<variant> variants{{"inline", JG_MOCK_COMPILE_BENCH_INCLUDE, false},
+                                  {"separate", JG_MOCK_COMPILE_BENCH_INCLUDE, true}};
+    int first_argument = 1;
+
+    for (; first_argument < argc && std::string(argv[first_argument]).compare(0, 2, "--") == 0; ++first_argument)
+    {
+        const std::string option = argv[first_argument];
+
+        if (option.compare(0, reference_option.size(), reference_option) == 0)
+            variants.push_back({"reference", option.substr(reference_option.size()), false});
+        else if (option.compare(0, standard_option.size(), standard_option) == 0)
+            standard = option.substr(standard_option.size());
+        else
+        {
+            std::cerr << "Unknown option " << option << "\n";
+            return 1;
+        }
+    }
+
+    const size_t mocks = argc > first_argument ? std::strtoul(argv[first_argument], nullptr, 10) : 200;
+    std::vector<size_t> arities;
+
+    for (int i = first_argument + 1; i < argc; ++i)
+        arities.push_back(std::strtoul(argv[i], nullptr, 10));
+
+    if (arities.empty())
+        arities = {0, 1, 2, 4, 8, 16};
+
+    std::cout << "jg_mock_compile_bench (" << JG_MOCK_COMPILE_BENCH_CXX << ", " << standard << ", unoptimized)...\n\n";
+    std::cout << "verify, arity, mocks, preprocessed (lines), front end (s), compile (s), object size (KiB), front end per mock (ms)\n";
+
+    // An empty translation unit, except for the headers, is the baseline that the mocks add to.
+    std::vector<std::pair<size_t, size_t>> configurations{{0, 0}};
+
+    for (const auto arity : arities)
+        configurations.emplace_back(arity, mocks);
+
+    for (const auto& configuration : configurations)
+    {
+        const auto arity = configuration.first;
+        const auto count = configuration.second;
+        const auto name = "jg_mock_compile_bench_" + std::to_string(count) + "x" + std::to_string(arity);
+        const auto source_path = name + ".cpp";
+        const auto object_path = name + ".o";
+        const auto preprocessed_path = name + ".i";
+
+        std::ofstream(source_path) << generate(count, arity);
+
+        for (const auto& headers : variants)
+        {
+            std::cout << headers.name << ", " << (count == 0 ? std::string("-") : std::to_string(arity)) << ", " << count << ", ";
+
+            if (compile(source_path, preprocessed_path, step::preprocess, headers) < 0)
+            {
+                std::cout << "preprocessing failed: " << source_path << "\n";
+                continue;
+            }
+
+            std::cout << line_count(preprocessed_path) << ", " << std::flush;
+
+            // Reference headers that predate parts of the generated mocks still get their line count.
+            const auto front_end = compile(source_path, object_path, step::syntax_only, headers);
+            const auto total = compile(source_path, object_path, step::compile, headers);
+
+            if (front_end < 0 || total < 0)
+            {
+                std::cout << "compilation failed: " << source_path << "\n";
+                continue;
+            }
+
+            std::cout << front_end << ", " << total << ", " << file_size(object_path) / 1024.0 << ", "
+                      << (count == 0 ? 0.0 : front_end * 1000 / count) << "\n";
+        }
+    }
+
+    std::cout << "\n...done";
+}
@@ -0,0 +1,97 @@
+// Profiles a few worker threads with `jg::sampler` and writes the collapsed stacks to the standard
+// output, for instance for flamegraph.pl:
+//
+//     jg_sampler [seconds] > profile.folded && flamegraph.pl profile.folded > profile.svg
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <jg_sampler.h>
+
+#ifdef _MSC_VER
+#define JG_SAMPLE_NOINLINE __declspec(noinline)
+#else
+#define JG_SAMPLE_NOINLINE __attribute__((noinline))
+#endif
+
+namespace
+{
+
+std::atomic<bool> g_done{false};
+std::atomic<double> g_sink{0};
+std::mutex g_mutex;
+
+JG_SAMPLE_NOINLINE double compute(size_t n)
+{
+    double sum = 0;
+
+    for (size_t i = 1; i < n; ++i)
+        sum += std::sqrt(static_cast<double>(i));
+
+    return sum;
+}
+
+JG_SAMPLE_NOINLINE double hot_path()
+{
+    return compute(300000);
+}
+
+JG_SAMPLE_NOINLINE double cold_path()
+{
+    return compute(100000);
+}
+
+JG_SAMPLE_NOINLINE void contended_path()
+{
+    std::lock_guard<std::mutex> lock{g_mutex};
+    g_sink = g_sink + compute(20000);
+}
+
+JG_SAMPLE_NOINLINE void worker(jg::sampler& profiler)
+{
+    jg::sampler::thread_scope sampled{profiler};
+
+    while (!g_done)
+    {
+        g_sink = g_sink + hot_path() + cold_path();
+        contended_path();
+    }
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    const auto seconds = argc > 1 ? std::atof(argv[1]) : 1.0;
+
+    jg::sampler profiler;
+    profiler.interval(std::chrono::milliseconds(1)).overhead_budget(0.01);
+
+    if (!profiler.start())
+    {
+        std::cerr << "jg::sampler couldn't be started\n";
+        return 1;
+    }
+
+    std::vector<std::thread> workers;
+
+    for (int i = 0; i < 4; ++i)
+        workers.emplace_back([&] { worker(profiler); });
+
+    std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+    g_done = true;
+
+    for (auto& thread : workers)
+        thread.join();
+
+    profiler.stop();
+    profiler.write_collapsed(std::cout);
+
+    const auto statistics = profiler.stats();
+    std::cerr << statistics.samples << " samples, " << statistics.dropped_samples << " dropped, interval "
+              << statistics.interval.count() << " us\n";
+}
@@ -0,0 +1,175 @@
+#include <array>
+#include <chrono>
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <jg_stacktrace.h>
+#include <jg_stacktrace_compact.h>
+
+namespace
+{
+
+volatile size_t g_sink = 0;
+
+template <typename F>
+void measure(const char* name, size_t iterations, F&& f, size_t operations_per_iteration = 1)
+{
+    const auto start = std::chrono::steady_clock::now();
+
+    for (size_t i = 0; i < iterations; ++i)
+        f();
+
+    const auto elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start);
+    std::cout << name << ": " << elapsed.count() / (iterations * operations_per_iteration) << " ns/op\n";
+}
+
+// Gives the captured stack traces a realistic depth.
+template <size_t Depth>
+struct nest final
+{
+    template <typename F>
+    JG_STACK_TRACE_NOINLINE static void call(F& f)
+    {
+        nest<Depth - 1>::call(f);
+        g_sink = g_sink + 1;
+    }
+};
+
+template <>
+struct nest<0> final
+{
+    template <typename F>
+    static void call(F& f)
+    {
+        f();
+    }
+};
+
+// The iostream formatting that `operator<<` used before `jg::format_stack_frame()`, as a baseline.
+void iostream_format(std::ostream& stream, const jg::stack_frame& frame)
+{
+    stream << "\t"
+           << frame.function
+           << " [0x" << std::hex << frame.address << " + 0x" << frame.address_displacement << "]";
+
+    if (!frame.file.empty())
+        stream << " at " << frame.file << "(" << std::dec << frame.line << ")";
+}
+
+// The heap memory of a string, which is none if it fits in the string object itself.
+size_t heap_bytes(const std::string& string)
+{
+    return string.capacity() > std::string{}.capacity() ? string.capacity() + 1 : 0;
+}
+
+size_t heap_bytes(const std::vector<std::vector<jg::stack_frame>>& traces)
+{
+    size_t bytes = traces.capacity() * sizeof(traces[0]);
+
+    for (const auto& frames : traces)
+    {
+        bytes += frames.capacity() * sizeof(jg::stack_frame);
+
+        for (const auto& frame : frames)
+            bytes += heap_bytes(frame.package) + heap_bytes(frame.function) + heap_bytes(frame.file);
+    }
+
+    return bytes;
+}
+
+} // namespace
+
+int main()
+{
+#ifdef _WIN32
+    std::cout << "jg_stacktrace_bench (Windows, DbgHelp)...\n\n";
+#else
+    std::cout << "jg_stacktrace_bench (POSIX, _Unwind_Backtrace + dladdr/ELF/DWARF)...\n\n";
+#endif
+
+    const auto trace = jg::stack_trace().include_frame_count(32);
+    jg::raw_stack_trace raw_trace;
+
+    auto capture_raw = [&] { raw_trace = trace.capture_raw(); };
+    nest<16>::call(capture_raw);
+    std::cout << "frames per trace: " << raw_trace.size() << "\n\n";
+
+    // The first resolve includes initializing the symbol session or parsing the module debug info.
+    measure("resolve (first)", 1, [&] { g_sink = g_sink + raw_trace.resolve().size(); });
+    measure("resolve (modules loaded, address cache cleared)", 100, [&]
+    {
+        jg::clear_symbol_cache();
+        g_sink = g_sink + raw_trace.resolve().size();
+    });
+    measure("resolve (cached)", 10000, [&] { g_sink = g_sink + raw_trace.resolve().size(); });
+
+    measure("capture_raw", 100000, [&] { nest<16>::call(capture_raw); });
+
+    auto capture = [&] { g_sink = g_sink + trace.capture().size(); };
+    measure("capture (cached)", 10000, [&] { nest<16>::call(capture); });
+
+    // Formatting is measured per frame, into sinks that are reused so that only the formatting is measured.
+    const auto frames = raw_trace.resolve();
+    const auto frame_count = frames.empty() ? size_t{1} : frames.size();
+    const size_t format_iterations = 100000 / frame_count;
+    std::cout << "\n";
+
+    std::ostringstream stream;
+    measure("format frame (iostream, per frame)", format_iterations * frame_count, [&]
+    {
+        const auto& frame = frames[g_sink++ % frame_count];
+        stream.seekp(0);
+        iostream_format(stream, frame);
+        stream << "\n";
+    });
+
+    std::array<char, 512> buffer;
+    measure("format frame (char buffer, per frame)", format_iterations * frame_count, [&]
+    {
+        const auto& frame = frames[g_sink++ % frame_count];
+        g_sink = g_sink + jg::format_stack_frame(frame, buffer.data(), buffer.size());
+    });
+
+    std::string text;
+    measure("format trace (std::string, per frame)", format_iterations, [&]
+    {
+        text.clear();
+        jg::format_stack_trace(frames, text);
+        g_sink = g_sink + text.size();
+    }, frame_count);
+
+    // Keeping many symbolized traces, as `std::vector<jg::stack_frame>`s and as `jg::compact_stack_traces`,
+    // where the traces differ in their innermost frames like the unique traces of an aggregator do.
+    const size_t stored_count = 10000;
+    std::vector<std::vector<jg::stack_frame>> stored(stored_count, frames);
+
+    for (size_t i = 0; i < stored_count && !frames.empty(); ++i)
+        stored[i][0].address_displacement = i;
+
+    jg::stack_symbol_table table;
+    jg::compact_stack_traces compact{table};
+    std::cout << "\n";
+
+    measure("compact_stack_traces::add (per frame)", stored_count, [&]
+    {
+        compact.add(stored[compact.size()]);
+    }, frame_count);
+    measure("compact_stack_traces::frames (per frame)", stored_count, [&]
+    {
+        g_sink = g_sink + compact.frames(g_sink % stored_count).size();
+    }, frame_count);
+
+    const auto table_statistics = table.stats();
+    const auto compact_bytes = compact.frame_count() * sizeof(jg::compact_stack_frame) + (compact.size() + 1) * sizeof(size_t) +
+                               table_statistics.string_bytes + table_statistics.symbols * 24; // 24 bytes per interned symbol.
+    std::cout << stored_count << " traces as std::vector<jg::stack_frame>: " << heap_bytes(stored) / 1024 << " KiB\n";
+    std::cout << stored_count << " traces as jg::compact_stack_traces: " << compact_bytes / 1024 << " KiB ("
+              << table_statistics.strings << " strings, " << table_statistics.symbols
+              << " symbols, not counting the hash table overhead of the symbol table)\n";
+
+    const auto statistics = jg::symbol_cache_stats();
+    std::cout << "\nsymbol cache: " << statistics.hits << " hits, " << statistics.misses << " misses, "
+              << statistics.size << "/" << statistics.capacity << " entries\n";
+
+    std::cout << "\n...done";
+}
@@ -0,0 +1,40 @@
+#include <fstream>
+#include <iostream>
+#include <jg_stacktrace_dump.h>
+
+// Symbolizes a stack trace dump written by jg::stack_trace_dump_writer, against the binaries of the
+// process that wrote it.
+int main(int argc, char* argv[])
+{
+    if (argc < 2)
+    {
+        std::cerr << "usage: jg_stacktrace_symbolize <dump file> [<binary search directory>...]\n";
+        return 2;
+    }
+
+    std::ifstream file(argv[1], std::ios::binary);
+    jg::stack_trace_dump_reader reader(file);
+    jg::stack_trace_dump_symbolizer symbolizer({argv + 2, argv + argc});
+
+    std::vector<jg::dump_frame> trace;
+    size_t trace_count = 0;
+
+    while (reader.next(trace))
+    {
+        std::cout << "trace " << ++trace_count << ":\n";
+
+        for (const auto& frame : symbolizer.symbolize(trace, reader.modules()))
+            std::cout << frame << "\n";
+
+        std::cout << "\n";
+    }
+
+    for (const auto& warning : symbolizer.warnings())
+        std::cerr << "warning: " << warning << "\n";
+
+    if (reader.failed())
+    {
+        std::cerr << "error: " << argv[1] << " isn't a valid stack trace dump\n";
+        return 1;
+    }
+}
@@ -0,0 +1,96 @@
+// Measures the trim functions on log line sized and multi-KiB inputs, in place and on views, against the
+// original `std::string` versions. Build optimized (e.g. CMAKE_BUILD_TYPE=Release) for meaningful numbers.
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <jg_string.h>
+
+namespace
+{
+
+volatile size_t g_sink = 0;
+
+template <typename F>
+void measure(const char* name, size_t iterations, F&& f)
+{
+    const auto start = std::chrono::steady_clock::now();
+
+    for (size_t i = 0; i < iterations; ++i)
+        f();
+
+    const auto elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start);
+    std::cout << name << ": " << elapsed.count() / iterations << " ns/op\n";
+}
+
+// The versions that the in place overloads replaced, as the baseline.
+std::string& original_trim_left(std::string& string, const std::string& chars = "\t\n\v\f\r ")
+{
+    return string.erase(0, string.find_first_not_of(chars));
+}
+
+std::string& original_trim_right(std::string& string, const std::string& chars = "\t\n\v\f\r ")
+{
+    return string.erase(string.find_last_not_of(chars) + 1);
+}
+
+std::string& original_trim(std::string& string, const std::string& chars = "\t\n\v\f\r ")
+{
+    return original_trim_left(original_trim_right(string, chars), chars);
+}
+
+void measure_input(const char* description, const std::string& input, size_t iterations)
+{
+    std::cout << description << " (" << input.size() << " characters):\n";
+
+    // The in place versions trim a copy of the input, into a string whose capacity is reused.
+    std::string copy;
+    copy.reserve(input.size());
+
+    measure("  copy only (baseline of the in place versions)", iterations, [&]
+    {
+        copy.assign(input);
+        g_sink = g_sink + copy.size();
+    });
+    measure("  original trim(std::string&)", iterations, [&]
+    {
+        copy.assign(input);
+        g_sink = g_sink + original_trim(copy).size();
+    });
+    measure("  trim(std::string&)", iterations, [&]
+    {
+        copy.assign(input);
+        g_sink = g_sink + jg::trim(copy).size();
+    });
+    measure("  trim(std::string_view)", iterations, [&]
+    {
+        g_sink = g_sink + jg::trim(std::string_view{input}).size();
+    });
+    measure("  trim(std::string_view, chars)", iterations, [&]
+    {
+        g_sink = g_sink + jg::trim(std::string_view{input}, "\t\n\v\f\r ").size();
+    });
+}
+
+} // namespace
+
+int main()
+{
+#ifdef JG_STRING_SSE2
+    std::cout << "jg_string_bench (SSE2)...\n\n";
+#else
+    std::cout << "jg_string_bench...\n\n";
+#endif
+
+    const std::string log_line = "  2026-10-14T12:00:00.123Z INFO  [worker-7] request 4711 served in 12 ms from cache\r\n";
+    const std::string untrimmed_line = "2026-10-14T12:00:00.123Z INFO  [worker-7] request 4711 served in 12 ms from cache";
+    const std::string padded_block = std::string(1024, ' ') + std::string(2048, 'x') + std::string(1024, '\t');
+    const std::string text_block = "\n" + std::string(4096, 'x') + "\n";
+
+    measure_input("log line", log_line, 10000000);
+    measure_input("log line without whitespace", untrimmed_line, 10000000);
+    measure_input("block with 1 KiB whitespace at each end", padded_block, 1000000);
+    measure_input("block with a newline at each end", text_block, 1000000);
+
+    std::cout << "\n...done";
+}
@@ -0,0 +1,87 @@
+// Measures the cost of passing verifications in a checked release build, where they're enabled
+// with the failure path writing stack traces. Build optimized (e.g. CMAKE_BUILD_TYPE=Release).
+#ifndef JG_VERIFY_ENABLE_STACK_TRACE
+#define JG_VERIFY_ENABLE_STACK_TRACE
+#endif
+
+#include <chrono>
+#include <iostream>
+#include <numeric>
+#include <vector>
+#include <jg_verify.h>
+
+namespace
+{
+
+volatile size_t g_sink = 0;
+
+template <typename F>
+void measure(const char* name, size_t iterations, F&& f)
+{
+    const auto start = std::chrono::steady_clock::now();
+
+    for (size_t i = 0; i < iterations; ++i)
+        f();
+
+    const auto elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start);
+    std::cout << name << ": " << elapsed.count() / iterations << " ns/op\n";
+}
+
+// Each sum verifies an element invariant per element, which is a typical hot path verification.
+JG_STACK_TRACE_NOINLINE size_t sum_unverified(const std::vector<size_t>& values, size_t limit)
+{
+    size_t sum = 0;
+
+    for (const auto value : values)
+        sum += value % limit;
+
+    return sum;
+}
+
+JG_STACK_TRACE_NOINLINE size_t sum_verify_function(const std::vector<size_t>& values, size_t limit)
+{
+    size_t sum = 0;
+
+    for (const auto value : values)
+    {
+        jg::verify(value < limit);
+        sum += value % limit;
+    }
+
+    return sum;
+}
+
+JG_STACK_TRACE_NOINLINE size_t sum_verify_macro(const std::vector<size_t>& values, size_t limit)
+{
+    size_t sum = 0;
+
+    for (const auto value : values)
+    {
+        JG_VERIFY(value < limit);
+        sum += value % limit;
+    }
+
+    return sum;
+}
+
+} // namespace
+
+int main()
+{
+    std::cout << "jg_verify_bench (JG_VERIFY_ENABLE_STACK_TRACE)...\n\n";
+
+    std::vector<size_t> values(4096);
+    std::iota(values.begin(), values.end(), size_t{0});
+    const size_t limit = values.size() + g_sink;
+
+    // Interleaved rounds, so that frequency scaling affects each variant alike.
+    for (int round = 0; round < 3; ++round)
+    {
+        measure("sum (no verification)", 20000, [&] { g_sink = g_sink + sum_unverified(values, limit); });
+        measure("sum (jg::verify)", 20000, [&] { g_sink = g_sink + sum_verify_function(values, limit); });
+        measure("sum (JG_VERIFY)", 20000, [&] { g_sink = g_sink + sum_verify_macro(values, limit); });
+        std::cout << "\n";
+    }
+
+    std::cout << "...done";
+}
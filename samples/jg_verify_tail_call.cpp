@@ -0,0 +1,70 @@
+// Checks that the function of a failed verification is in its stack trace when the verification is the
+// last statement of the function, where the call of the failure path could otherwise be compiled as a
+// tail call. Returns 0 if it is, for both `JG_VERIFY` and `jg::verify`. Built optimized, since that's
+// when compilers make tail calls.
+#ifndef NDEBUG
+#define NDEBUG // Report the failures without aborting.
+#endif
+
+#ifndef JG_VERIFY_ENABLE_STACK_TRACE
+#define JG_VERIFY_ENABLE_STACK_TRACE
+#endif
+
+#include <iostream>
+#include <string>
+#include <jg_verify.h>
+
+namespace
+{
+
+class checking_sink final : public jg::verify_failure_sink
+{
+public:
+    void write(const jg::verify_failure& failure) override
+    {
+        bool found = false;
+
+        for (const auto& frame : jg::symbolize(failure.addresses, failure.address_count))
+            found = found || frame.function.find(m_function) != std::string::npos;
+
+        std::cout << (failure.expression ? "JG_VERIFY" : "jg::verify") << " in tail position: "
+                  << (found ? "the failing function is in the stack trace\n" : "the failing function is missing\n");
+
+        m_failed = m_failed || !found;
+        m_reports++;
+    }
+
+    void expect(const char* function) { m_function = function; }
+    bool passed() const { return !m_failed && m_reports == 2; }
+
+private:
+    const char* m_function = "";
+    bool m_failed = false;
+    int m_reports = 0;
+};
+
+JG_STACK_TRACE_NOINLINE void verify_macro_last(int value)
+{
+    JG_VERIFY(value < 0);
+}
+
+JG_STACK_TRACE_NOINLINE void verify_function_last(int value)
+{
+    jg::verify(value < 0);
+}
+
+} // namespace
+
+int main(int argc, char*[])
+{
+    static checking_sink sink;
+    jg::set_verify_failure_sink(&sink);
+
+    sink.expect("verify_macro_last");
+    verify_macro_last(argc);
+    sink.expect("verify_function_last");
+    verify_function_last(argc);
+
+    jg::set_verify_failure_sink(nullptr);
+    return sink.passed() ? 0 : 1;
+}
@@ -0,0 +1,6 @@
+// The failure path of `jg::verify` and `JG_VERIFY`, and the members of `jg::async_verify_failure_sink`,
+// for programs that define JG_VERIFY_SEPARATE_IMPLEMENTATION in every translation unit, so that only
+// this one includes `jg_verify_async.h`, `jg_stacktrace.h` and their threading and platform headers.
+// Compile it once per program, with the same NDEBUG and JG_VERIFY_* flags.
+#define JG_VERIFY_IMPLEMENTATION
+#include <jg_verify.h>